@@ -8,7 +8,40 @@
     THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <psapi.h>
+#define EASYDDS_THREAD_LOCAL __declspec(thread)
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#define EASYDDS_THREAD_LOCAL __thread
+#endif
+/* stb_image and stb_image_resize allocate from the arena of the image that the calling thread is converting (see struct Arena) */
+struct Arena;
+static EASYDDS_THREAD_LOCAL struct Arena* currentArena;
+static void* arenaAlloc(struct Arena* arena, size_t size);
+static void* arenaRealloc(struct Arena* arena, void* p, size_t newSize);
+static void arenaFree(struct Arena* arena, void* p);
+#define STBI_MALLOC(size) arenaAlloc(currentArena, size)
+#define STBI_REALLOC(p, newSize) arenaRealloc(currentArena, p, newSize)
+#define STBI_FREE(p) arenaFree(currentArena, p)
+#define STBIR_MALLOC(size, context) ((void)(context), arenaAlloc(currentArena, size))
+#define STBIR_FREE(p, context) ((void)(context), arenaFree(currentArena, p))
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF    /* see the AVX-512 kernels below; GCC doesn't contract without FMA in the target */
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #define STB_DXT_IMPLEMENTATION
@@ -16,6 +49,24 @@
 #include "stb_image_resize.h"
 #include "stb_dxt.h"
 
+/* Kernels are compiled for several x86 instruction sets and picked at runtime where the compiler supports target attributes */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(STBI_SSE2)
+#define EASYDDS_DISPATCH
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define EASYDDS_FORCEINLINE inline __attribute__((always_inline))
+#define EASYDDS_FLATTEN __attribute__((flatten))   /* inline everything, including stb_dxt, into specialized loops */
+#elif defined(_MSC_VER)
+#define EASYDDS_FORCEINLINE __forceinline
+#define EASYDDS_FLATTEN
+#else
+#define EASYDDS_FORCEINLINE inline
+#define EASYDDS_FLATTEN
+#endif
+
 enum DDSFlags
 {
 	DDSD_CAPS = 0x00000001, 		/* dwCaps/dwCaps2 is enabled. */
@@ -28,26 +79,52 @@ enum DDSFlags
 	DDSD_DEPTH = 0x00800000 		/* dwDepth is enabled. Used for 3D (Volume) Texture. */
 };
 
+/* Where messages go; stderr when the DDS is written to stdout, so that it stays clean */
+static FILE* logFile;
+static void logPrintf(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(logFile, format, args);
+    va_end(args);
+}
+
 static void printHelp()
 {
     printf(
         "EasyDDS - Convert various image formats to block-compressed DDS textures\n"
         "(c)2019-2020 daigennki\n"
-        "Usage: <InputFile> [options]\n"
-        "Supported input image formats: JPEG, PNG, TGA, BMP, PSD, GIF, HDR, PIC, PNM\n"
+        "Usage: <InputFile>... [options]\n"
+        "An input file of - is read from stdin\n"
+        "Supported input image formats: JPEG, PNG, TGA, BMP, PSD, GIF, HDR, PIC, PNM, QOI\n"
         "Options:\n"
         "\t-bc1: Output with BC1/DXT1 compression (RGB)\n"
         "\t-bc3: Output with BC3/DXT5 compression (RGBA)\n"
         "\t-bc4: Output with BC4/ATI1 compression (R)\n"
         "\t-bc5: Output with BC5/ATI2 compression (RG)\n"
-        "\t-nomip: Don't generate mipmaps (by default, mipmaps are generated)"
+        "\t-nomip: Don't generate mipmaps (by default, a full chain down to 1x1 is generated)\n"
+        "\t-mipfilter <box|tent|mitchell|kaiser|lanczos>: Filter used to generate mipmaps (default: mitchell)\n"
+        "\t-linearmips: Keep mipmaps in row-major order while converting instead of 4x4 blocks\n"
+        "\t-nodither: Don't dither colors before BC1/BC3 compression\n"
+        "\t-fast: Use a single refinement step for BC1/BC3 colors instead of two (faster, slightly lower quality)\n"
+        "\t-threads <n>: Number of threads to use (default: number of CPUs)\n"
+        "\t-hugepages: Back the memory of each conversion with huge pages where the OS supports it\n"
+        "\t-jobs <n>: Number of images to convert at the same time (default: enough to keep every stage busy)\n"
+        "\t-stages <read>,<decode>,<mips>,<write>: Number of threads for each stage that images go through (default: 1,1,1,1)\n"
+        "\t-o <OutputFile>: Output file for a single input instead of the input file name with .dds, or - for stdout\n"
+        "\t-fsync: Make sure that every output file is on disk before it counts as converted\n"
+        "\t-journal <file>: Record converted input files in this file and skip the ones it already lists with the same output and format\n"
+        "\t-readahead <n>: Number of upcoming files to read into the OS cache while others are being converted (default: 2)\n"
+        "\t-membudget <bytes>[K|M|G]: Keep the estimated memory use of the images being converted within this limit\n"
+        "\t-isa <sse2|avx2|avx512>: Use the kernels for the given instruction set instead of the best one this CPU supports (also settable with the EASYDDS_ISA environment variable)\n"
+        "\t-refdecode: Decode input images with the simple reference code of stb_image instead of the optimized one (slower, for checking the latter)\n"
         "If no -bc* option was specified, the output format will be chosen depending on the number of channels in the input.\n"
         "Note: Use -bc5 for normal maps. Results may appear incorrect if the other options are used.\n"
     );
 }
 static void writeHeader(FILE* outputFile, int w, int h, int channels, int mipCount)
 {
-    printf("Writing header...\n");
+    logPrintf("Writing header...\n");
     /* write header */
     struct {
         char magic[4];	/* always "DDS " */
@@ -76,11 +153,14 @@ static void writeHeader(FILE* outputFile, int w, int h, int channels, int mipCou
 
     memcpy(header.magic, "DDS ", 4);
     header.size = 124;
-    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
     header.height = h;
     header.width = w;
     const int blockSize = (channels == 2 || channels == 4 ? 16 : 8);
-    header.pitchOrLinearSize = (w / 4) * blockSize;
+    /* size of the first level, partial blocks included, unless that doesn't fit */
+    const uint64_t linearSize = (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * blockSize;
+    if (linearSize <= UINT32_MAX) header.pitchOrLinearSize = (uint32_t)linearSize;
+    else header.flags &= ~DDSD_LINEARSIZE;
     header.mipMapCount = mipCount;
     memcpy(header.reserved1, "EasyDDS", 8);
     header.pfSize = 32;
@@ -91,200 +171,1922 @@ static void writeHeader(FILE* outputFile, int w, int h, int channels, int mipCou
     memcpy(header.fourCC, fourccs[channels - 1], 4);
 
     header.caps = 0x1000;   /* DDSCAPS_TEXTURE */
-    if (mipCount > 1) header.caps |= 0x400000;
+    if (mipCount > 1) header.caps |= 0x400008;   /* DDSCAPS_MIPMAP | DDSCAPS_COMPLEX */
     
     fwrite(&header, sizeof(header), 1, outputFile);
 }
-static void writeData(FILE* outputFile, const int w, const int h, const int channels, const int mipCount, const stbi_uc* inRow)
+/* Storage layout of the mipmaps handed from mip generation to the encoder */
+enum MipLayout
+{
+	MIP_LAYOUT_LINEAR, 		/* row-major pixels with `channels` bytes per pixel, as returned by stbi_load */
+	MIP_LAYOUT_BLOCK 		/* rows of encoder-ready 4x4 blocks, so the encoder reads every level sequentially */
+};
+/* Filters for halving mip levels */
+enum MipFilterType
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_TENT,
+	MIP_FILTER_MITCHELL, 	/* Mitchell-Netravali cubic with B = C = 1/3, the one stb_image_resize downsamples with */
+	MIP_FILTER_KAISER, 		/* Kaiser-windowed sinc, width 3 and alpha 4 */
+	MIP_FILTER_LANCZOS 		/* Lanczos with 3 lobes */
+};
+static const char* const mipFilterNames[] = { "box", "tent", "mitchell", "kaiser", "lanczos" };
+#define MAX_MIP_FILTER_TAPS 6
+/* A symmetric filter for exact 2:1 reduction: weights[t] applies to both source pixels t away from the two at the center */
+struct MipFilter
+{
+    enum MipFilterType type;
+    double radius;  /* in destination pixels */
+    int taps;
+    float weights[MAX_MIP_FILTER_TAPS];
+};
+static double sinc(double x)
+{
+    return (x == 0 ? 1.0 : sin(3.14159265358979323846 * x) / (3.14159265358979323846 * x));
+}
+static double besselI0(double x)
 {
-    writeHeader(outputFile, w, h, channels, mipCount);
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+/* Value of a filter at distance x (in destination pixels, within its radius) from the destination pixel center */
+static double mipFilterKernel(const enum MipFilterType type, const double x)
+{
+    switch (type)
+    {
+    case MIP_FILTER_BOX: return 1.0;
+    case MIP_FILTER_TENT: return 1.0 - x;
+    case MIP_FILTER_MITCHELL: return (x < 1.0 ? 16.0 + x * x * (21.0 * x - 36.0) : 32.0 + x * (-60.0 + x * (36.0 - 7.0 * x))) / 18.0;
+    case MIP_FILTER_KAISER: return sinc(x) * besselI0(4.0 * sqrt(1.0 - (x / 3.0) * (x / 3.0))) / besselI0(4.0);
+    case MIP_FILTER_LANCZOS: return sinc(x) * sinc(x / 3.0);
+    }
+    return 0.0;
+}
+static void initMipFilter(struct MipFilter* filter, const enum MipFilterType type)
+{
+    const double radii[] = { 0.5, 1.0, 2.0, 3.0, 3.0 };
+    filter->type = type;
+    filter->radius = radii[type];
+    filter->taps = (int)(filter->radius * 2);
+    assert(filter->taps <= MAX_MIP_FILTER_TAPS);
+    double weights[MAX_MIP_FILTER_TAPS], sum = 0;
+    for (int t = 0; t < filter->taps; ++t)
+    {
+        weights[t] = mipFilterKernel(type, (t + 0.5) / 2);     /* the source pixel centers are 1/4, 3/4, ... destination pixels away */
+        sum += 2 * weights[t];
+    }
+    for (int t = 0; t < filter->taps; ++t) filter->weights[t] = (float)(weights[t] / sum);
+}
 
-    unsigned char rgbaBuf[64];
-    memset(rgbaBuf, 0, 64);
-    unsigned char bcBuf[16];
-    printf("Writing data...\n");
-    const int blockSize = (channels == 2 || channels == 4 ? 16 : 8);
-    printf("Block size: %i\n", blockSize);
-    const int pixBufStride = (channels == 3 ? 4 : channels);    /* stb_compress_dxt_block expects RGBA even for no alpha */
-    int mw = w, mh = h;
-    for (unsigned int m = 0; m < mipCount; ++m, mw /= 2, mh /= 2)
+/* Weights for reducing an odd number of pixels n to n / 2 along one axis, or 1 to 1. The destination pixels don't line up
+   with pairs of source pixels there, so each one has its own taps, starting at source pixel first[i] (clamped to the edges). */
+#define MAX_MIP_AXIS_TAPS (4 * MAX_MIP_FILTER_TAPS)
+struct MipAxisWeights
+{
+    int taps;
+    int* first;
+    float* weights;     /* taps per destination pixel */
+};
+static int initMipAxisWeights(struct MipAxisWeights* axis, const struct MipFilter* filter, const int n)
+{
+    const int m = (n > 1 ? n / 2 : 1);
+    const double scale = (double)n / m;     /* source pixels per destination pixel, at most 3 */
+    const double radius = filter->radius * scale;   /* in source pixels */
+    axis->taps = (int)ceil(2 * radius) + 1;
+    assert(axis->taps <= MAX_MIP_AXIS_TAPS);
+    axis->first = malloc(m * sizeof(int));
+    axis->weights = malloc(m * axis->taps * sizeof(float));
+    if (!axis->first || !axis->weights) return 0;
+    for (int i = 0; i < m; ++i)
     {
-        int maxRows;
-        for (int y = 0; y < mh; y += 4, inRow += mw * 4 * 3)    /* every 4 rows */
+        const double center = (i + 0.5) * scale;
+        const int first = (int)floor(center - radius);
+        double weights[MAX_MIP_AXIS_TAPS], sum = 0;
+        for (int t = 0; t < axis->taps; ++t)
         {
-            /* calculate rows and columns left so we can copy for dimensions that aren't multiples of 4 */
-            if (mh - y > 4) maxRows = 4;
-            else
+            const int p = first + t;
+            if (filter->type == MIP_FILTER_BOX)
             {
-                int rowsLeftMod = (mh - y) % 4;
-                maxRows = (rowsLeftMod == 0 ? 4 : rowsLeftMod);
+                /* the box covers some source pixels only partially, so use the covered part of each */
+                const double lo = (p > center - radius ? p : center - radius), hi = (p + 1 < center + radius ? p + 1 : center + radius);
+                weights[t] = (hi > lo ? hi - lo : 0.0);
             }
-            int maxCols;
-            for (int x = 0; x < mw; x += 4, inRow += maxCols * 4)     /* every 4 columns */
+            else
             {
-                if (mw - x > 4) maxCols = 4;
-                else
-                {
-                    int colsLeftMod = (mw - x) % 4;
-                    maxCols = (colsLeftMod == 0 ? 4 : colsLeftMod);
-                }
-
-                for (int i = 0; i < maxRows; ++i)     /* every row in the 4x4 RGBA pixel block */
-                {
-                    for (int k = 0; k < maxCols; ++k)
-                    {
-                        memcpy(rgbaBuf + (i * 4 + k) * pixBufStride, inRow + (i * mw + k) * 4, channels);
-                    }
-                }
-                switch (channels)
-                {
-                case 3:
-                case 4:
-                    stb_compress_dxt_block(bcBuf, rgbaBuf, (channels == 4 ? 1 : 0), STB_DXT_DITHER | STB_DXT_HIGHQUAL);
-                    break;
-                case 1:
-                    stb_compress_bc4_block(bcBuf, rgbaBuf);
-                    break;
-                case 2:
-                    stb_compress_bc5_block(bcBuf, rgbaBuf);
-                    break;
-                }
-                fwrite(bcBuf, blockSize, 1, outputFile);
+                const double x = fabs(p + 0.5 - center) / scale;
+                weights[t] = (x < filter->radius ? mipFilterKernel(filter->type, x) : 0.0);
             }
+            sum += weights[t];
         }
+        axis->first[i] = first;
+        for (int t = 0; t < axis->taps; ++t) axis->weights[i * axis->taps + t] = (float)(weights[t] / sum);
     }
+    return 1;
 }
-static unsigned char* genMips(const int w, const int h, int allowGenMips, const int srgb, const unsigned char* firstMip, int* const mipCountOut)
+
+/* The hot kernels, compiled once per instruction set and picked at startup by selectKernels */
+typedef void (*EncodeBandFunc)(unsigned char* outBlocks, const unsigned char* inMip, const int mw, const int mh, const int y0, const int y1, const enum MipLayout layout, unsigned char* blockRow);
+struct Kernels
 {
-    assert(mipCountOut);
-    if ((w % 2) || (h % 2)) allowGenMips = 0;    /* the original dimensions have odd width or height, so don't generate mipmaps */
-    int mipCount = 1;
-    int mipSize = w * h * 4;
-    int totalMipSize = mipSize;
-    int mw = w / 2, mh = h / 2;
-    if (allowGenMips)
+    const char* name;
+    void (*gatherBlockRow)(unsigned char* outBlocks, const stbi_uc* inRow, const int mw, const int rows, const int channels, const int pixBufStride);
+    int (*reduceMip)(const float* inMip, const int w, const int h, float* outMip, const int mw, const int channels, const struct MipFilter* filter,
+        const struct MipAxisWeights* oddX, const struct MipAxisWeights* oddY, const int firstRow, const int y0, const int y1);
+    void (*toLinear)(float* out, const stbi_uc* in, const size_t pixelCount, const int channels);
+    void (*fromLinear)(stbi_uc* out, const float* in, const size_t pixelCount, const int channels);
+    EncodeBandFunc encodeBand[4][4];
+};
+
+#ifdef STBI_SSE2
+#define EASYDDS_KERNEL_NAME "sse2"
+#else
+#define EASYDDS_KERNEL_NAME "generic"
+#endif
+#define EASYDDS_KERNEL(name) name##_base
+#define EASYDDS_TARGET
+#define EASYDDS_KERNEL_AVX2 0
+#define EASYDDS_KERNEL_AVX512 0
+#include "easydds_kernels.h"
+#undef EASYDDS_KERNEL_NAME
+#undef EASYDDS_KERNEL
+#undef EASYDDS_TARGET
+#undef EASYDDS_KERNEL_AVX2
+#undef EASYDDS_KERNEL_AVX512
+
+#ifdef EASYDDS_DISPATCH
+#define EASYDDS_KERNEL_NAME "avx2"
+#define EASYDDS_KERNEL(name) name##_avx2
+#define EASYDDS_TARGET __attribute__((target("avx2")))
+#define EASYDDS_KERNEL_AVX2 1
+#define EASYDDS_KERNEL_AVX512 0
+#include "easydds_kernels.h"
+#undef EASYDDS_KERNEL_NAME
+#undef EASYDDS_KERNEL
+#undef EASYDDS_TARGET
+#undef EASYDDS_KERNEL_AVX2
+#undef EASYDDS_KERNEL_AVX512
+
+/* AVX-512F brings FMA along, which must not be contracted into so that float results match the other kernels exactly */
+#define EASYDDS_KERNEL_NAME "avx512"
+#define EASYDDS_KERNEL(name) name##_avx512
+#ifdef __clang__
+#define EASYDDS_TARGET __attribute__((target("avx2,avx512f,avx512bw,avx512vl")))
+#else
+#define EASYDDS_TARGET __attribute__((target("avx2,avx512f,avx512bw,avx512vl"), optimize("fp-contract=off")))
+#endif
+#define EASYDDS_KERNEL_AVX2 1
+#define EASYDDS_KERNEL_AVX512 1
+#include "easydds_kernels.h"
+#undef EASYDDS_KERNEL_NAME
+#undef EASYDDS_KERNEL
+#undef EASYDDS_TARGET
+#undef EASYDDS_KERNEL_AVX2
+#undef EASYDDS_KERNEL_AVX512
+
+static const struct Kernels* const allKernels[] = { &kernels_base, &kernels_avx2, &kernels_avx512 };
+#else
+static const struct Kernels* const allKernels[] = { &kernels_base };
+#endif
+static const struct Kernels* kernels = &kernels_base;
+
+/* Returns how many entries of allKernels this CPU (and OS) can run */
+static int supportedKernelCount()
+{
+#ifdef EASYDDS_DISPATCH
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return 1;
+    unsigned int xcr0, xcr0High;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+    if ((xcr0 & 0x06) != 0x06) return 1;     /* OS doesn't save SSE and AVX state */
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) return 1;
+    const unsigned int avx512Bits = bit_AVX512F | bit_AVX512BW | bit_AVX512VL;
+    if ((ebx & avx512Bits) != avx512Bits || (xcr0 & 0xe0) != 0xe0) return 2;     /* no AVX-512, or the OS doesn't save its state */
+    return 3;
+#else
+    return 1;
+#endif
+}
+/* Picks the best kernels for this CPU, or the ones named by isaName (from -isa or the EASYDDS_ISA environment variable) */
+static int selectKernels(const char* isaName)
+{
+    const int supportedCount = supportedKernelCount();
+    kernels = allKernels[supportedCount - 1];
+    if (!isaName || !isaName[0]) return 1;
+    for (int i = 0; i < (int)(sizeof(allKernels) / sizeof(allKernels[0])); ++i)
     {
-        /* Determine number of possible mipmaps */
-        mipSize /= 4;
-        for (; mw >= 1 && mh >= 1; mw /= 2, mh /= 2, mipSize /= 4) 
+        if (strcmp(isaName, allKernels[i]->name)) continue;
+        if (i >= supportedCount)
         {
-            ++mipCount;
-            totalMipSize += mipSize;
-            if ((mw % 2) || (mh % 2)) break; /* don't generate any more mipmaps if dimensions for this mipmap are odd */
+            logPrintf("Error: This CPU does not support '%s'\n", isaName);
+            return 0;
         }
-        mipSize = w * h * 4;
+        kernels = allKernels[i];
+        return 1;
     }
+    logPrintf("Error: '%s' is not a known instruction set\n", isaName);
+    return 0;
+}
 
-    /* Allocate memory for mipmaps */
-    printf("Allocating output (%i bytes)...\n", totalMipSize);
-    unsigned char* mipData = malloc(totalMipSize);
+/* Just enough threading to run tasks on a pool of worker threads */
+#ifdef _WIN32
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+#define mutexInit(m) InitializeCriticalSection(m)
+#define mutexLock(m) EnterCriticalSection(m)
+#define mutexUnlock(m) LeaveCriticalSection(m)
+#define condInit(c) InitializeConditionVariable(c)
+#define condWait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define condSignal(c) WakeConditionVariable(c)
+#define condBroadcast(c) WakeAllConditionVariable(c)
+static void startThread(DWORD (WINAPI *func)(void*), void* arg)
+{
+    CloseHandle(CreateThread(NULL, 0, func, arg, 0, NULL));
+}
+#define THREAD_FUNC(name) static DWORD WINAPI name(void* arg)
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#define syncFile(file) _commit(_fileno(file))
+#define setBinaryMode(file) _setmode(_fileno(file), _O_BINARY)
+#define isRegularFile(file) (GetFileType((HANDLE)_get_osfhandle(_fileno(file))) == FILE_TYPE_DISK)
+#define replaceFile(from, to) (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : (errno = EIO, -1))
+static int cpuCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+static double currentSeconds()
+{
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / frequency.QuadPart;
+}
+#else
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+#define mutexInit(m) pthread_mutex_init(m, NULL)
+#define mutexLock(m) pthread_mutex_lock(m)
+#define mutexUnlock(m) pthread_mutex_unlock(m)
+#define condInit(c) pthread_cond_init(c, NULL)
+#define condWait(c, m) pthread_cond_wait(c, m)
+#define condSignal(c) pthread_cond_signal(c)
+#define condBroadcast(c) pthread_cond_broadcast(c)
+static void startThread(void* (*func)(void*), void* arg)
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, func, arg);
+    pthread_detach(thread);
+}
+#define THREAD_FUNC(name) static void* name(void* arg)
+#define fseek64 fseeko
+#define ftell64 ftello
+#define syncFile(file) fsync(fileno(file))
+#define setBinaryMode(file) ((void)(file))
+static int isRegularFile(FILE* file)
+{
+    struct stat status;
+    return (!fstat(fileno(file), &status) && S_ISREG(status.st_mode));
+}
+#define replaceFile(from, to) rename(from, to)
+static int cpuCount()
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0 ? (int)count : 1);
+}
+static double currentSeconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+#endif
 
-    /* Copy original data for first mipmap */
-    memcpy(mipData, firstMip, mipSize);
+struct Task
+{
+    void (*func)(void* arg);
+    void* arg;
+};
+/* Worker threads take tasks from a FIFO queue; threadCount includes the main thread, which runs tasks while it waits for them */
+static struct
+{
+    Mutex mutex;
+    Cond taskAdded;         /* also signalled when the main thread may be done waiting */
+    struct Task* tasks;     /* ring buffer */
+    int taskCapacity, taskHead, taskCount;
+    int reserved;           /* slots taken with poolReserve that haven't been pushed yet */
+    int threadCount;
+} pool;
 
-    /* Generate mipmaps by resizing */
-    printf("Generating %i mipmaps: 0 (%i)", mipCount, mipSize);
-    unsigned char* currentMip = mipData + mipSize;
-    unsigned char* mipEnd = mipData + totalMipSize;
-    mipSize /= 4;
-    mw = w / 2, mh = h / 2;
-    for (int i = 1; i < mipCount; ++i)
+/* Queue operations; pool.mutex must be held. Every push takes a slot reserved beforehand, so that only poolReserve can run out of
+   memory, before any of the tasks it is for are queued; tasks that queue more tasks then never fail to. Returns 0 if it couldn't. */
+static int poolReserve(const int count)
+{
+    const int needed = pool.taskCount + pool.reserved + count;
+    if (needed > pool.taskCapacity)
     {
-        assert((currentMip + mipSize) <= mipEnd);
-        printf(", %i (%i)", i, mipSize);
-        if (srgb) stbir_resize_uint8_srgb(firstMip, w, h, 0, currentMip, mw, mh, 0, 4, 3, 0);
-        else stbir_resize_uint8(firstMip, w, h, 0, currentMip, mw, mh, 0, 4);
-        currentMip += mipSize;
-        mw /= 2, mh /= 2;
-        mipSize /= 4;
+        /* grow the ring buffer, unwrapping it in the process */
+        int newCapacity = (pool.taskCapacity ? pool.taskCapacity * 2 : 64);
+        while (newCapacity < needed) newCapacity *= 2;
+        struct Task* newTasks = malloc(newCapacity * sizeof(struct Task));
+        if (!newTasks) return 0;
+        for (int i = 0; i < pool.taskCount; ++i) newTasks[i] = pool.tasks[(pool.taskHead + i) % pool.taskCapacity];
+        free(pool.tasks);
+        pool.tasks = newTasks;
+        pool.taskCapacity = newCapacity;
+        pool.taskHead = 0;
     }
-    printf("\n");
+    pool.reserved += count;
+    return 1;
+}
+static void poolPush(void (*func)(void* arg), void* arg)
+{
+    assert(pool.reserved > 0);
+    --pool.reserved;
+    pool.tasks[(pool.taskHead + pool.taskCount) % pool.taskCapacity] = (struct Task){ func, arg };
+    ++pool.taskCount;
+    condSignal(&pool.taskAdded);
+}
+static int poolPop(struct Task* task)
+{
+    if (!pool.taskCount) return 0;
+    *task = pool.tasks[pool.taskHead];
+    pool.taskHead = (pool.taskHead + 1) % pool.taskCapacity;
+    --pool.taskCount;
+    return 1;
+}
 
-    *mipCountOut = mipCount;
-    return mipData;
+THREAD_FUNC(poolWorker)
+{
+    (void)arg;
+    struct Task task;
+    mutexLock(&pool.mutex);
+    for (;;)
+    {
+        while (!poolPop(&task)) condWait(&pool.taskAdded, &pool.mutex);
+        mutexUnlock(&pool.mutex);
+        task.func(task.arg);
+        mutexLock(&pool.mutex);
+    }
+    return 0;
+}
+static void poolInit(const int threadCount)
+{
+    mutexInit(&pool.mutex);
+    condInit(&pool.taskAdded);
+    pool.threadCount = threadCount;
+    for (int i = 1; i < threadCount; ++i) startThread(poolWorker, NULL);
+}
+/* Runs tasks on the calling thread until *done is set by one of them (under pool.mutex, followed by poolWakeAll) */
+static void poolRunUntil(const int* done)
+{
+    struct Task task;
+    mutexLock(&pool.mutex);
+    while (!*done)
+    {
+        if (!poolPop(&task))
+        {
+            condWait(&pool.taskAdded, &pool.mutex);
+            continue;
+        }
+        mutexUnlock(&pool.mutex);
+        task.func(task.arg);
+        mutexLock(&pool.mutex);
+    }
+    mutexUnlock(&pool.mutex);
+}
+static void poolWakeAll()
+{
+    condBroadcast(&pool.taskAdded);
+}
+/* The parallel-for that stb_image splits JPEG decoding with: the tasks go on the pool, and the decoding thread helps until they are done */
+struct ParallelFor
+{
+    void (*task)(void* arg, int index);
+    void* arg;
+    int next, remaining, done;  /* protected by pool.mutex */
+};
+static void runParallelTask(void* arg)
+{
+    struct ParallelFor* pf = arg;
+    mutexLock(&pool.mutex);
+    const int index = pf->next++;
+    mutexUnlock(&pool.mutex);
+    pf->task(pf->arg, index);
+    mutexLock(&pool.mutex);
+    if (!--pf->remaining)
+    {
+        pf->done = 1;
+        poolWakeAll();
+    }
+    mutexUnlock(&pool.mutex);
+}
+static void parallelFor(int count, void (*task)(void* arg, int index), void* arg)
+{
+    struct ParallelFor pf = { task, arg, 0, count, 0 };
+    mutexLock(&pool.mutex);
+    const int queued = poolReserve(count);
+    if (queued) for (int i = 0; i < count; ++i) poolPush(runParallelTask, &pf);
+    mutexUnlock(&pool.mutex);
+    if (queued) poolRunUntil(&pf.done);
+    else for (int i = 0; i < count; ++i) task(arg, i);     /* the same work, only on this thread */
 }
 
-int main(int argc, char** argv)
+/* Size arithmetic saturates at SIZE_MAX instead of wrapping around, so that allocating a size that doesn't fit simply fails */
+static size_t sizeMul(const size_t a, const size_t b)
 {
-    if (argc <= 1)
+    return (b && a > SIZE_MAX / b ? SIZE_MAX : a * b);
+}
+static size_t sizeAdd(const size_t a, const size_t b)
+{
+    return (a > SIZE_MAX - b ? SIZE_MAX : a + b);
+}
+/* A bump allocator that all the big buffers of a conversion come from, including stb_image's through STBI_MALLOC.
+   It is reserved once, sized from stbi_info, and emptied for each image it is used for, so its pages stay mapped in between.
+   Only the most recent allocation can be freed or grown in place; anything else is only reclaimed with the next image.
+   Whatever doesn't fit falls back to malloc, and so does everything without an arena. */
+#define ARENA_ALIGN 64
+struct Arena
+{
+    Mutex mutex;
+    unsigned char* base;
+    size_t size, used;
+    size_t top;         /* offset of the most recent allocation */
+    struct Arena* next; /* in the list of idle arenas */
+};
+static int arenaHugePages;
+
+static int arenaOwns(const struct Arena* arena, const void* p)
+{
+    return (arena && arena->base && (const unsigned char*)p >= arena->base && (const unsigned char*)p < arena->base + arena->size);
+}
+/* Every allocation is preceded by an ARENA_ALIGN-sized slot that stores its size */
+static size_t arenaBlockSize(const size_t size)
+{
+    return sizeAdd(size, 2 * ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+static void* arenaAlloc(struct Arena* arena, size_t size)
+{
+    unsigned char* p = NULL;
+    if (arena)
     {
-        printHelp();
-        return 0;
+        const size_t blockSize = arenaBlockSize(size);
+        mutexLock(&arena->mutex);
+        if (arena->base && blockSize <= arena->size - arena->used)
+        {
+            arena->top = arena->used;
+            arena->used += blockSize;
+            p = arena->base + arena->top + ARENA_ALIGN;
+            ((size_t*)p)[-1] = size;
+        }
+        mutexUnlock(&arena->mutex);
     }
-    
-    const char* inFilePath = NULL;
-    int channels = 0;
-    int allowGenMips = 1;
-    for (int i = 1; i < argc; ++i)
+    return (p ? p : malloc(size));
+}
+static void arenaFree(struct Arena* arena, void* p)
+{
+    if (!p) return;
+    if (!arenaOwns(arena, p))
+    {
+        free(p);
+        return;
+    }
+    mutexLock(&arena->mutex);
+    if ((unsigned char*)p == arena->base + arena->top + ARENA_ALIGN) arena->used = arena->top;
+    mutexUnlock(&arena->mutex);
+}
+static void* arenaRealloc(struct Arena* arena, void* p, size_t newSize)
+{
+    if (!p) return arenaAlloc(arena, newSize);
+    if (!arenaOwns(arena, p)) return realloc(p, newSize);
+    mutexLock(&arena->mutex);
+    const size_t oldSize = ((size_t*)p)[-1];
+    if ((unsigned char*)p == arena->base + arena->top + ARENA_ALIGN && arenaBlockSize(newSize) <= arena->size - arena->top)
+    {
+        /* the most recent allocation simply grows or shrinks */
+        arena->used = arena->top + arenaBlockSize(newSize);
+        ((size_t*)p)[-1] = newSize;
+        mutexUnlock(&arena->mutex);
+        return p;
+    }
+    mutexUnlock(&arena->mutex);
+    void* q = arenaAlloc(arena, newSize);
+    if (q) memcpy(q, p, (oldSize < newSize ? oldSize : newSize));
+    arenaFree(arena, p);
+    return q;
+}
+static struct Arena* arenaCreate()
+{
+    struct Arena* arena = calloc(1, sizeof(struct Arena));
+    mutexInit(&arena->mutex);
+    return arena;
+}
+/* Gives the memory of the arena back to the OS; it can still be used afterwards */
+static void arenaRelease(struct Arena* arena)
+{
+#ifdef _WIN32
+    if (arena->base) VirtualFree(arena->base, 0, MEM_RELEASE);
+#else
+    if (arena->base) munmap(arena->base, arena->size);
+#endif
+    arena->base = NULL;
+    arena->size = arena->used = arena->top = 0;
+}
+/* Empties the arena for the next image and makes sure it can hold size bytes; nothing may be allocated from it anymore */
+static void arenaBegin(struct Arena* arena, const size_t size)
+{
+    arena->used = arena->top = 0;
+    if (size <= arena->size) return;
+    arenaRelease(arena);
+    const size_t hugePageSize = (size_t)2 << 20;
+    const size_t reserveSize = sizeAdd(size, hugePageSize - 1) & ~(hugePageSize - 1);
+#ifdef _WIN32
+    arena->base = VirtualAlloc(NULL, reserveSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    /* only reserved here, pages are committed as they are touched */
+    arena->base = mmap(NULL, reserveSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena->base == MAP_FAILED) arena->base = NULL;
+#ifdef MADV_HUGEPAGE
+    if (arena->base && arenaHugePages) madvise(arena->base, reserveSize, MADV_HUGEPAGE);
+#endif
+#endif
+    arena->size = (arena->base ? reserveSize : 0);
+}
+
+static size_t mipLevelSize(const int mw, const int mh, const int channels, const enum MipLayout layout)
+{
+    if (layout == MIP_LAYOUT_LINEAR) return sizeMul(sizeMul(mw, mh), channels);
+    const int pixBufStride = (channels == 3 ? 4 : channels);
+    return sizeMul(sizeMul((mw + 3) / 4, (mh + 3) / 4), 16 * pixBufStride);
+}
+static size_t bcLevelSize(const int mw, const int mh, const int blockSize)
+{
+    return sizeMul(sizeMul((mw + 3) / 4, (mh + 3) / 4), blockSize);
+}
+/* Stores rows y0 to y1 of a level, given in row-major order starting at row y0, tiling them into blocks if requested;
+   y0 must be a multiple of 4 */
+static void storeMipRows(unsigned char* outMip, const stbi_uc* inRows, const int mw, const int mh, const int y0, const int y1, const int channels, const enum MipLayout layout)
+{
+    if (layout == MIP_LAYOUT_LINEAR)
+    {
+        memcpy(outMip + (size_t)y0 * mw * channels, inRows, (size_t)(y1 - y0) * mw * channels);
+        return;
+    }
+    const int pixBufStride = (channels == 3 ? 4 : channels);
+    const size_t blockRowSize = (size_t)((mw + 3) / 4) * 16 * pixBufStride;
+    outMip += (y0 / 4) * blockRowSize;
+    for (int y = y0; y < y1; y += 4, outMip += blockRowSize, inRows += (size_t)4 * mw * channels)
+    {
+        kernels->gatherBlockRow(outMip, inRows, mw, (mh - y < 4 ? mh - y : 4), channels, pixBufStride);
+    }
+}
+
+/* Mip generation and compression are scheduled as a graph of tasks on bands of rows. Generating a band of a level becomes
+   runnable as soon as the bands of the previous level it is filtered from are done, and compressing a band as soon as it has
+   been generated, so the small levels overlap with the large ones instead of waiting for each level to finish.
+   All task state is protected by pool.mutex. */
+#define MAX_MIP_LEVELS 32
+struct MipBand
+{
+    struct MipJob* job;
+    int level, y0, y1;
+    int pendingSources;     /* bands of the previous level that still have to be generated before this one can be */
+};
+struct MipLevel
+{
+    int w, h;
+    struct MipAxisWeights oddX, oddY;   /* for reducing an odd width or height of the previous level, otherwise taps is 0 */
+    unsigned char* mip;     /* 8-bit pixels in the layout of the job; the first level is the decoded image as it is */
+    float* linear;          /* linear-light pixels, freed once the next level is done; the first level may have none, see startMips */
+    unsigned char* bc;      /* compressed blocks */
+    int bandRows, bandCount, bandsPending, encodesPending;
+    struct MipBand* bands;
+};
+/* The compressed mip levels of an image, one after the other as they are stored in the file. The levels that are done can
+   already be written while the others are still being compressed. */
+struct CompressedMips
+{
+    unsigned char* data;
+    size_t size;
+    int levelCount;
+    size_t levelEnds[MAX_MIP_LEVELS];
+    /* protected by pool.mutex, and progress is signalled whenever either changes */
+    int levelsDone;         /* the first levels that are compressed */
+    int finished;           /* whether all other buffers of the mipmaps are freed */
+    int error;              /* ENOMEM if a band couldn't allocate its scratch memory, set before its level counts as done */
+    double seconds;         /* that generating them took */
+    Cond progress;
+};
+struct MipJob
+{
+    int channels;
+    enum MipLayout layout;
+    const struct MipFilter* filter;
+    EncodeBandFunc encodeBand;
+    struct Arena* arena;
+    int levelCount;
+    struct MipLevel levels[MAX_MIP_LEVELS];
+    struct MipBand* bands;
+    unsigned char* mipData;
+    struct CompressedMips* out;
+    int encodesPending, done;
+};
+
+/* Bands are multiples of 4 rows so that they can be tiled and compressed on their own, with a few bands per thread */
+static int mipBandRows(const int mh)
+{
+    int rows = (mh + pool.threadCount * 4 - 1) / (pool.threadCount * 4);
+    if (rows < 16) rows = 16;
+    return (rows + 3) & ~3;
+}
+/* Determines the rows of the previous level that a band is filtered from, s0 to s1 */
+static void sourceRows(const struct MipJob* job, const struct MipBand* band, int* s0, int* s1)
+{
+    const struct MipLevel* level = &job->levels[band->level];
+    if (level->oddY.taps)
+    {
+        *s0 = level->oddY.first[band->y0];
+        *s1 = level->oddY.first[band->y1 - 1] + level->oddY.taps;
+    }
+    else
+    {
+        /* tap t of reduceMip reads source rows 2y - t and 2y + 1 + t */
+        *s0 = 2 * band->y0 - (job->filter->taps - 1);
+        *s1 = 2 * band->y1 + job->filter->taps - 1;
+    }
+    /* clamped to the edges */
+    if (*s0 < 0) *s0 = 0;
+    if (*s1 > level[-1].h) *s1 = level[-1].h;
+}
+/* Determines the bands of the previous level that a band is filtered from */
+static void sourceBands(const struct MipJob* job, const struct MipBand* band, int* first, int* last)
+{
+    const struct MipLevel* prev = &job->levels[band->level - 1];
+    int s0, s1;
+    sourceRows(job, band, &s0, &s1);
+    *first = s0 / prev->bandRows;
+    *last = (s1 - 1) / prev->bandRows;
+}
+static void encodeMipBand(void* arg)
+{
+    struct MipBand* band = arg;
+    struct MipJob* job = band->job;
+    const struct MipLevel* level = &job->levels[band->level];
+    const int blockSize = (job->channels == 2 || job->channels == 4 ? 16 : 8);
+    const int pixBufStride = (job->channels == 3 ? 4 : job->channels);
+    const int blocksPerRow = (level->w + 3) / 4;
+    const enum MipLayout layout = (band->level ? job->layout : MIP_LAYOUT_LINEAR);
+    unsigned char* blockRow = (layout == MIP_LAYOUT_LINEAR ? malloc((size_t)blocksPerRow * 16 * pixBufStride) : NULL);
+    const int error = (layout == MIP_LAYOUT_LINEAR && !blockRow ? ENOMEM : 0);
+    if (!error) job->encodeBand(level->bc + (size_t)(band->y0 / 4) * blocksPerRow * blockSize, level->mip, level->w, level->h, band->y0, band->y1, layout, blockRow);
+    free(blockRow);
+
+    mutexLock(&pool.mutex);
+    struct CompressedMips* out = job->out;
+    if (error) out->error = error;
+    if (!--job->levels[band->level].encodesPending)
+    {
+        while (out->levelsDone < job->levelCount && !job->levels[out->levelsDone].encodesPending) ++out->levelsDone;
+        condBroadcast(&out->progress);
+    }
+    if (!--job->encodesPending)
+    {
+        job->done = 1;
+        poolWakeAll();
+    }
+    mutexUnlock(&pool.mutex);
+}
+static void genMipBand(void* arg)
+{
+    struct MipBand* band = arg;
+    struct MipJob* job = band->job;
+    struct MipLevel* level = &job->levels[band->level];
+    const int channels = job->channels, y0 = band->y0, y1 = band->y1;
+    const size_t rowLength = (size_t)level->w * channels;
+    int error = 0;
+    if (!band->level)
     {
-        if (argv[i][0] == '-')
+        /* the first level is encoded straight from the decoded image and only needs to be converted to linear light for the next one */
+        if (level->linear) kernels->toLinear(level->linear + y0 * rowLength, level->mip + y0 * rowLength, (size_t)(y1 - y0) * level->w, channels);
+    }
+    else
+    {
+        const struct MipLevel* prev = level - 1;
+        const float* inLinear = prev->linear;
+        int s0 = 0, s1;
+        if (!inLinear)
         {
-            if (!strcmp(argv[i], "-help"))
+            /* the first level isn't kept in linear light, so convert just the rows this band needs */
+            sourceRows(job, band, &s0, &s1);
+            const size_t prevRowLength = (size_t)prev->w * channels;
+            float* rows = malloc((s1 - s0) * prevRowLength * sizeof(float));
+            if (rows) kernels->toLinear(rows, prev->mip + s0 * prevRowLength, (size_t)(s1 - s0) * prev->w, channels);
+            else error = ENOMEM;
+            inLinear = rows;
+        }
+        if (!error) error = kernels->reduceMip(inLinear, prev->w, prev->h, level->linear, level->w, channels, job->filter,
+            (level->oddX.taps ? &level->oddX : NULL), (level->oddY.taps ? &level->oddY : NULL), s0, y0, y1);
+        if (inLinear != prev->linear) free((float*)inLinear);
+        /* in block layout, the band is converted into a scratch buffer first and then tiled */
+        if (!error && job->layout == MIP_LAYOUT_LINEAR)
+        {
+            kernels->fromLinear(level->mip + y0 * rowLength, level->linear + y0 * rowLength, (size_t)(y1 - y0) * level->w, channels);
+        }
+        else if (!error)
+        {
+            unsigned char* rows = malloc((y1 - y0) * rowLength);
+            if (rows)
             {
-                printHelp();
-                return 0;
+                kernels->fromLinear(rows, level->linear + y0 * rowLength, (size_t)(y1 - y0) * level->w, channels);
+                storeMipRows(level->mip, rows, level->w, level->h, y0, y1, channels, job->layout);
+                free(rows);
             }
-            else if (!strcmp(argv[i], "-bc1")) channels = 3;
-            else if (!strcmp(argv[i], "-bc3")) channels = 4;
-            else if (!strcmp(argv[i], "-bc4")) channels = 1;
-            else if (!strcmp(argv[i], "-bc5")) channels = 2;
-            else if (!strcmp(argv[i], "-nomip")) allowGenMips = 0;
-            else 
+            else error = ENOMEM;
+        }
+    }
+
+    /* The band can be compressed now, and the bands of the next level that only waited for this one can be generated. One that
+       failed goes on like the others, so that the job still finishes, and fails it in the end. */
+    mutexLock(&pool.mutex);
+    if (error) job->out->error = error;
+    poolPush(encodeMipBand, band);
+    if (!--level->bandsPending && band->level)
+    {
+        arenaFree(job->arena, level[-1].linear);
+        level[-1].linear = NULL;
+    }
+    if (band->level + 1 < job->levelCount)
+    {
+        struct MipLevel* next = level + 1;
+        const int index = (int)(band - level->bands);
+        for (int i = 0; i < next->bandCount; ++i)
+        {
+            int first, last;
+            sourceBands(job, &next->bands[i], &first, &last);
+            if (index >= first && index <= last && !--next->bands[i].pendingSources) poolPush(genMipBand, &next->bands[i]);
+        }
+    }
+    mutexUnlock(&pool.mutex);
+}
+
+static void freeMips(struct MipJob* job, unsigned char* bcData)
+{
+    for (int i = 0; i < job->levelCount; ++i)
+    {
+        arenaFree(job->arena, job->levels[i].linear);
+        free(job->levels[i].oddX.first);
+        free(job->levels[i].oddX.weights);
+        free(job->levels[i].oddY.first);
+        free(job->levels[i].oddY.weights);
+    }
+    arenaFree(job->arena, job->bands);
+    arenaFree(job->arena, bcData);
+    arenaFree(job->arena, job->mipData);
+}
+/* Starts generating the mipmaps of an image and compressing them into out on the pool; returns 0 or an errno value.
+   With lowMemory, the first level isn't converted to linear light as a whole; every band of the second level converts the rows
+   it needs instead, which costs some repeated work at the band edges but saves the biggest buffer of all. */
+static int startMips(struct MipJob* job, struct CompressedMips* out, const int w, const int h, int allowGenMips, const int channels, const int mode, const enum MipLayout layout, const struct MipFilter* filter,
+    unsigned char* firstMip, struct Arena* arena, const int lowMemory)
+{
+    *job = (struct MipJob){ .channels = channels, .layout = layout, .filter = filter, .encodeBand = kernels->encodeBand[channels - 1][mode & (STB_DXT_DITHER | STB_DXT_HIGHQUAL)], .arena = arena,
+        .levelCount = 1, .levels = { { .w = w, .h = h } }, .bands = NULL, .mipData = NULL, .out = NULL, .encodesPending = 0, .done = 0 };
+    const int blockSize = (channels == 2 || channels == 4 ? 16 : 8);
+    int weightsAllocated = 1;
+    if (allowGenMips)
+    {
+        /* Every level down to 1x1 is half the size of the previous one, rounded down */
+        for (int pw = w, ph = h; (pw > 1 || ph > 1) && job->levelCount < MAX_MIP_LEVELS; pw = (pw > 1 ? pw / 2 : 1), ph = (ph > 1 ? ph / 2 : 1))
+        {
+            struct MipLevel* level = &job->levels[job->levelCount++];
+            level->w = (pw > 1 ? pw / 2 : 1), level->h = (ph > 1 ? ph / 2 : 1);
+            if (pw % 2 && !initMipAxisWeights(&level->oddX, filter, pw)) weightsAllocated = 0;
+            if (ph % 2 && !initMipAxisWeights(&level->oddY, filter, ph)) weightsAllocated = 0;
+        }
+    }
+
+    /* Allocate memory for mipmaps; the first level is the decoded image itself */
+    size_t totalMipSize = 0, totalBcSize = 0;
+    int bandCount = 0;
+    for (int i = 0; i < job->levelCount; ++i)
+    {
+        struct MipLevel* level = &job->levels[i];
+        if (i) totalMipSize = sizeAdd(totalMipSize, mipLevelSize(level->w, level->h, channels, layout));
+        totalBcSize = sizeAdd(totalBcSize, bcLevelSize(level->w, level->h, blockSize));
+        level->bandRows = mipBandRows(level->h);
+        level->bandCount = (level->h + level->bandRows - 1) / level->bandRows;
+        bandCount += level->bandCount;
+    }
+    logPrintf("Allocating output (%zu bytes)...\n", totalMipSize);
+    unsigned char* mipData = arenaAlloc(arena, totalMipSize);
+    unsigned char* bcData = arenaAlloc(arena, totalBcSize);
+    struct MipBand* bands = arenaAlloc(arena, bandCount * sizeof(struct MipBand));
+    job->bands = bands, job->mipData = mipData, job->out = out;
+    int allocated = ((mipData || !totalMipSize) && bcData && bands && weightsAllocated);
+    for (int i = (lowMemory ? 1 : 0); i < job->levelCount && job->levelCount > 1; ++i)
+    {
+        job->levels[i].linear = arenaAlloc(arena, sizeMul(sizeMul(sizeMul(job->levels[i].w, job->levels[i].h), channels), sizeof(float)));
+        if (!job->levels[i].linear) allocated = 0;
+    }
+    /* each band is generated and compressed by a task of its own */
+    mutexLock(&pool.mutex);
+    if (allocated && !poolReserve(2 * bandCount)) allocated = 0;
+    mutexUnlock(&pool.mutex);
+    if (!allocated)
+    {
+        logPrintf("Error: Not enough memory to convert a %ix%i image\n", w, h);
+        freeMips(job, bcData);
+        return ENOMEM;
+    }
+
+    char mipList[MAX_MIP_LEVELS * 32];
+    int mipListLength = 0;
+    unsigned char* currentMip = mipData;
+    unsigned char* currentBc = bcData;
+    struct MipBand* currentBand = bands;
+    for (int i = 0; i < job->levelCount; ++i)
+    {
+        struct MipLevel* level = &job->levels[i];
+        const size_t mipSize = mipLevelSize(level->w, level->h, channels, (i ? layout : MIP_LAYOUT_LINEAR));
+        mipListLength += snprintf(mipList + mipListLength, sizeof(mipList) - mipListLength, "%s %i (%zu)", (i ? "," : ""), i, mipSize);
+        level->mip = (i ? currentMip : firstMip);
+        level->bc = currentBc;
+        level->bands = currentBand;
+        level->bandsPending = level->encodesPending = level->bandCount;
+        if (i) currentMip += mipSize;
+        currentBc += bcLevelSize(level->w, level->h, blockSize);
+        out->levelEnds[i] = currentBc - bcData;
+        currentBand += level->bandCount;
+        for (int b = 0; b < level->bandCount; ++b)
+        {
+            struct MipBand* band = &level->bands[b];
+            band->job = job;
+            band->level = i;
+            band->y0 = b * level->bandRows;
+            band->y1 = (band->y0 + level->bandRows < level->h ? band->y0 + level->bandRows : level->h);
+            band->pendingSources = 0;
+            if (i)
             {
-                printf("Error: '%s' is not a known argument\n", argv[i]);
-                return EINVAL;
+                int first, last;
+                sourceBands(job, band, &first, &last);
+                band->pendingSources = last - first + 1;
             }
         }
-        else if (!inFilePath) inFilePath = argv[i];
     }
-    if (!inFilePath)
+    logPrintf("Generating %i mipmaps:%s\n", job->levelCount, mipList);
+    logPrintf("Block size: %i\n", blockSize);
+
+    out->data = bcData;
+    out->size = totalBcSize;
+    out->levelCount = job->levelCount;
+    out->levelsDone = out->finished = out->error = 0;
+    condInit(&out->progress);
+
+    /* every band is generated and compressed, and the first level has no dependencies to start off with */
+    job->encodesPending = bandCount;
+    mutexLock(&pool.mutex);
+    for (int b = 0; b < job->levels[0].bandCount; ++b) poolPush(genMipBand, &job->levels[0].bands[b]);
+    mutexUnlock(&pool.mutex);
+    return 0;
+}
+/* Helps on the pool until the mipmaps of startMips are compressed, then frees everything but the compressed data */
+static void finishMips(struct MipJob* job)
+{
+    poolRunUntil(&job->done);
+    freeMips(job, NULL);
+}
+
+/* Estimates what converting an image allocates from its arena: the file, the decoded image, stb_image's own buffers (for PNG,
+   the compressed data and the unfiltered rows are still in the arena after decoding) and what startMips allocates until finishMips frees it */
+static size_t estimateJobMemory(const size_t fileSize, const int w, const int h, const int loadChannels, const int channels, const enum MipLayout layout, const int allowGenMips, const int lowMemory)
+{
+    const int blockSize = (channels == 2 || channels == 4 ? 16 : 8);
+    size_t total = sizeAdd(fileSize, sizeMul(sizeMul(sizeMul(w, h), loadChannels), 4));
+    total = sizeAdd(total, bcLevelSize(w, h, blockSize));
+    if (allowGenMips && (w > 1 || h > 1))
+    {
+        if (!lowMemory) total = sizeAdd(total, sizeMul(sizeMul(sizeMul(w, h), channels), sizeof(float)));
+        for (int mw = w, mh = h; mw > 1 || mh > 1; )
+        {
+            mw = (mw > 1 ? mw / 2 : 1), mh = (mh > 1 ? mh / 2 : 1);
+            total = sizeAdd(total, mipLevelSize(mw, mh, channels, layout));
+            total = sizeAdd(total, bcLevelSize(mw, mh, blockSize));
+            total = sizeAdd(total, sizeMul(sizeMul(sizeMul(mw, mh), channels), sizeof(float)));
+        }
+    }
+    return sizeAdd(total, (size_t)1 << 20);  /* the band table, file names and stb_image's smaller allocations */
+}
+/* Peak resident memory of the whole process so far, or 0 if it is unknown */
+static size_t peakMemoryUse()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/* Conversion settings from the command line, shared by all images of a batch */
+struct Options
+{
+    int channels;   /* 0 to choose by the channels of each image */
+    int allowGenMips;
+    int mode;
+    enum MipLayout layout;
+    struct MipFilter filter;
+    int syncOutput;     /* flush every output file to disk before it counts as done */
+    const char* outFilePath;    /* for a single input, - for stdout, or NULL to put the outputs next to the inputs */
+};
+/* One image of a batch, as probed with stbi_info */
+struct ConvertJob
+{
+    const char* inFilePath;
+    const struct Options* options;
+    size_t fileSize;
+    int w, h, channels, loadChannels;
+    int greyToRG;           /* a grey source for BC5, loaded as grey and alpha, whose grey goes to both R and G */
+    int lowMemory;          /* see startMips */
+    size_t memoryEstimate;
+    double timeEstimate;    /* in seconds, see estimateJobTime */
+    int index;              /* on the command line */
+    struct Arena* arena;
+    int result;
+    double seconds;         /* that its stages actually took, without waiting in between */
+    /* handed from stage to stage */
+    unsigned char* fileData;
+    int fileRead;           /* stdin or a pipe, read whole by probeImage */
+    int fileMapped;         /* or read into the arena */
+    stbi_uc* image;
+    int imageInFile;        /* whether image points into fileData, see decodeRaw */
+    struct CompressedMips mips;
+};
+
+/* Estimates how long converting an image takes when it has the pool to itself. The cost per pixel of the decoding, the mipmaps
+   and the compression of every format is a rough measurement of a PNG on one thread of a desktop CPU, so only the ratios between
+   images are meaningful; the actual times printed for each image are there to calibrate it. */
+static double estimateJobTime(const int w, const int h, const int channels, const int mode, const int allowGenMips)
+{
+    static const double nanosecondsPerPixel[4][2] =
     {
-        printf("Error: No input file given\n");
+        /* fast, high quality */
+        { 40, 45 },     /* BC4 */
+        { 50, 60 },     /* BC5 */
+        { 100, 110 },   /* BC1 */
+        { 95, 105 },    /* BC3 */
+    };
+    double pixels = (double)w * h;
+    if (allowGenMips) pixels *= 4.0 / 3.0;  /* every mip level has a quarter of the pixels of the last one */
+    return pixels * nanosecondsPerPixel[channels - 1][(mode & STB_DXT_HIGHQUAL) != 0] * 1e-9 / pool.threadCount;
+}
+
+/* stb_image takes the size of a buffer in memory as an int, so files of 2 GiB or more are fed to it through callbacks instead */
+struct MemoryStream
+{
+    const unsigned char* data;
+    size_t size, pos;
+};
+static int memoryStreamRead(void* user, char* out, int size)
+{
+    struct MemoryStream* stream = user;
+    const size_t n = ((size_t)size < stream->size - stream->pos ? (size_t)size : stream->size - stream->pos);
+    memcpy(out, stream->data + stream->pos, n);
+    stream->pos += n;
+    return (int)n;
+}
+static void memoryStreamSkip(void* user, int n)
+{
+    struct MemoryStream* stream = user;
+    const size_t distance = (size_t)(n < 0 ? -(ptrdiff_t)n : n);
+    if (n < 0) stream->pos = (distance < stream->pos ? stream->pos - distance : 0);
+    else stream->pos = (distance < stream->size - stream->pos ? stream->pos + distance : stream->size);
+}
+static int memoryStreamEof(void* user)
+{
+    const struct MemoryStream* stream = user;
+    return stream->pos >= stream->size;
+}
+static const stbi_io_callbacks memoryStreamCallbacks = { memoryStreamRead, memoryStreamSkip, memoryStreamEof };
+static int infoFromMemory(const unsigned char* data, const size_t size, int* w, int* h, int* channels)
+{
+    if (size <= INT_MAX) return stbi_info_from_memory(data, (int)size, w, h, channels);
+    struct MemoryStream stream = { data, size, 0 };
+    return stbi_info_from_callbacks(&memoryStreamCallbacks, &stream, w, h, channels);
+}
+static stbi_uc* loadFromMemory(const unsigned char* data, const size_t size, int* w, int* h, const int desiredChannels)
+{
+    if (size <= INT_MAX) return stbi_load_from_memory(data, (int)size, w, h, NULL, desiredChannels);
+    struct MemoryStream stream = { data, size, 0 };
+    return stbi_load_from_callbacks(&memoryStreamCallbacks, &stream, w, h, NULL, desiredChannels);
+}
+
+/* Reads all of a stream into a malloc'd buffer; returns 0 or an errno value */
+static int readStream(FILE* file, unsigned char** data, size_t* size)
+{
+    size_t capacity = (size_t)1 << 20;
+    *size = 0;
+    *data = malloc(capacity);
+    while (*data)
+    {
+        *size += fread(*data + *size, 1, capacity - *size, file);
+        if (*size < capacity) break;
+        unsigned char* grown = realloc(*data, capacity * 2);
+        if (!grown) free(*data);
+        *data = grown;
+        capacity *= 2;
+    }
+    if (!*data) return ENOMEM;
+    if (ferror(file))
+    {
+        free(*data);
+        return EIO;
+    }
+    return 0;
+}
+
+/* Probes an image and picks the strategy to convert it with; returns 0 or an error code */
+static int probeImage(struct ConvertJob* job, const size_t memoryBudget)
+{
+    int fileChannels, valid;
+    const int fromStdin = !strcmp(job->inFilePath, "-");
+    FILE* inputFile = (fromStdin ? stdin : fopen(job->inFilePath, "rb"));
+    if (!inputFile)
+    {
+        const int error = errno;
+        logPrintf("Error: Failed to open file '%s': %s\n", job->inFilePath, strerror(error));
+        return error;
+    }
+    if (fromStdin) setBinaryMode(stdin);
+    if (fromStdin || !isRegularFile(inputFile))
+    {
+        /* stdin and pipes can only be read once and have no size up front, so they are read whole right away */
+        const int error = readStream(inputFile, &job->fileData, &job->fileSize);
+        if (!fromStdin) fclose(inputFile);
+        if (error)
+        {
+            if (fromStdin) logPrintf("Error: Failed to read stdin: %s\n", strerror(error));
+            else logPrintf("Error: Failed to read file '%s': %s\n", job->inFilePath, strerror(error));
+            return error;
+        }
+        job->fileRead = 1;
+        valid = infoFromMemory(job->fileData, job->fileSize, &job->w, &job->h, &fileChannels);
+    }
+    else
+    {
+        fseek64(inputFile, 0, SEEK_END);
+        job->fileSize = (size_t)ftell64(inputFile);
+        fseek64(inputFile, 0, SEEK_SET);
+        valid = stbi_info_from_file(inputFile, &job->w, &job->h, &fileChannels);
+        fclose(inputFile);
+    }
+    if (!valid)
+    {
+        logPrintf("Error: Failed to load file '%s': %s\n", job->inFilePath, stbi_failure_reason());
         return 1;
     }
+    /* only set channels parameter if it was not specified in the options */
+    job->channels = (job->options->channels ? job->options->channels : fileChannels);
+    assert(job->channels >= 1 && job->channels <= 4);
+    /* Load the image with only as many channels as the output format needs. stb_image would turn RGB(A) into luminance
+       for 1 or 2 channels, but BC4/BC5 take the R and RG channels as they are, so extract those ourselves in that case.
+       A grey image has grey in R and G (and B) like any other, so BC5 gets its grey twice rather than its alpha. */
+    job->loadChannels = (job->channels <= 2 && fileChannels >= 3 ? fileChannels : job->channels);
+    job->greyToRG = (job->channels == 2 && fileChannels <= 2);
+
+    const struct Options* options = job->options;
+    job->lowMemory = 0;
+    job->memoryEstimate = estimateJobMemory(job->fileSize, job->w, job->h, job->loadChannels, job->channels, options->layout, options->allowGenMips, 0);
+    if (job->memoryEstimate > memoryBudget)
+    {
+        job->lowMemory = 1;
+        job->memoryEstimate = estimateJobMemory(job->fileSize, job->w, job->h, job->loadChannels, job->channels, options->layout, options->allowGenMips, 1);
+        logPrintf("'%s' needs less memory when its mipmaps are made in bands (about %zu MiB)\n", job->inFilePath, job->memoryEstimate >> 20);
+        if (job->memoryEstimate > memoryBudget) logPrintf("Warning: '%s' still exceeds the memory budget, so it will be converted on its own\n", job->inFilePath);
+    }
+    job->timeEstimate = estimateJobTime(job->w, job->h, job->channels, options->mode, options->allowGenMips);
+    return 0;
+}
+/* Orders the images of a batch longest first, so that a big one doesn't start last and keep the others waiting for it at the
+   end; images that failed to probe come last and ties keep the order of the command line */
+static int compareJobs(const void* a, const void* b)
+{
+    const struct ConvertJob* jobA = a;
+    const struct ConvertJob* jobB = b;
+    if (!jobA->result != !jobB->result) return (jobA->result ? 1 : -1);
+    if (jobA->timeEstimate != jobB->timeEstimate) return (jobA->timeEstimate > jobB->timeEstimate ? -1 : 1);
+    return jobA->index - jobB->index;
+}
+
+/* Maps a whole file for reading; returns NULL if that isn't possible, like for a pipe */
+static unsigned char* mapFile(const char* path, size_t* size)
+{
+    unsigned char* data = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 && (unsigned long long)fileSize.QuadPart <= SIZE_MAX)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            *size = (size_t)fileSize.QuadPart;
+        }
+    }
+    CloseHandle(file);
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0) return NULL;
+    struct stat status;
+    if (!fstat(file, &status) && S_ISREG(status.st_mode) && status.st_size > 0 && (unsigned long long)status.st_size <= SIZE_MAX)
+    {
+        data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) data = NULL;
+        /* decoders read the file front to back, so the kernel can read all of it ahead of them and drop pages behind */
+        if (data) madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+        if (data) madvise(data, (size_t)status.st_size, MADV_WILLNEED);
+        *size = (size_t)status.st_size;
+    }
+    close(file);
+#endif
+    return data;
+}
+static void unmapFile(unsigned char* data, const size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+/* Asks the OS to start reading a file into its cache in the background, so that it's there by the time the file is mapped.
+   There is no such hint on Windows, where this does nothing. */
+static void prefetchFile(const char* path)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    const int file = open(path, O_RDONLY);
+    if (file < 0) return;
+    posix_fadvise(file, 0, 0, POSIX_FADV_WILLNEED);
+    close(file);
+#else
+    (void)path;
+#endif
+}
 
-    /* load file and its parameters; only set channels parameter if it was not specified in the options */
-    printf("Loading file '%s'...\n", inFilePath);
+enum Stage
+{
+    STAGE_READ,
+    STAGE_DECODE,
+    STAGE_MIPS,     /* generates and compresses the mipmaps on the pool */
+    STAGE_WRITE,
+    STAGE_COUNT
+};
+static const char* const stageNames[] = { "read", "decode", "mips", "write" };
+struct StageQueue
+{
+    int (*run)(struct ConvertJob* job);
+    int passesOn;           /* whether the stage queues the image for the next stage itself when it succeeds */
+    int threadCount;
+    Cond notEmpty, notFull;
+    struct ConvertJob** jobs;   /* a ring buffer of threadCount */
+    int first, count;
+};
+
+/* Images are admitted to the stages as -jobs and -membudget allow, and their bands all run on the shared pool.
+   All of this is protected by pool.mutex. */
+static struct
+{
+    struct StageQueue stages[STAGE_COUNT];
+    Cond jobDone;
+    int running, maxJobs;
+    size_t budget;                  /* SIZE_MAX if there is none */
+    size_t memoryInUse, peakMemory; /* estimates of the running jobs */
+    struct Arena* idleArenas;
+    FILE* journal;                  /* see loadJournal */
+} batch;
+/* What is left of the memory budget; 0 while a job that exceeds it on its own is running */
+static size_t budgetLeft()
+{
+    return (batch.memoryInUse < batch.budget ? batch.budget - batch.memoryInUse : 0);
+}
+
+/* Queues an image for a stage, waiting while its queue is full */
+static void stagePush(struct StageQueue* stage, struct ConvertJob* job)
+{
+    mutexLock(&pool.mutex);
+    while (stage->count == stage->threadCount) condWait(&stage->notFull, &pool.mutex);
+    stage->jobs[(stage->first + stage->count++) % stage->threadCount] = job;
+    condSignal(&stage->notEmpty);
+    mutexUnlock(&pool.mutex);
+}
+/* Uncompressed PNM, TGA and BMP files are read without stb_image, which would copy all pixels into a buffer of its own and
+   convert them in a second pass. Where the file has the rows and channels that the mipmaps need, the first level is the file
+   itself; otherwise every row is converted from the file in one pass. The results are the same as stb_image's. */
+struct RawImage
+{
+    size_t offset;          /* of the first row of the image in the file */
+    ptrdiff_t rowStride;    /* negative for files that are stored bottom-up */
+    int channels;           /* 1, 3 or 4 */
+    int bgr;                /* whether the colour channels are in BGR order */
+    int opaqueIfNoAlpha;    /* BMP: an alpha channel that is 0 everywhere is taken as opaque */
+};
+static uint32_t readLE(const unsigned char* p, const int bytes)
+{
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+static int isPnmSpace(const unsigned char c)
+{
+    return (c && memchr(" \t\n\v\f\r", c, 6));
+}
+/* Recognizes the uncompressed formats that can be read directly and checks them against the size that stbi_info found;
+   returns 0 for anything else, which is left to stb_image */
+static int parseRawImage(const unsigned char* data, const size_t size, const char* path, const int w, const int h, struct RawImage* raw)
+{
+    memset(raw, 0, sizeof(*raw));
+    size_t rowLength;
+    int topDown = 1;
+    if (size >= 3 && data[0] == 'P' && (data[1] == '5' || data[1] == '6'))
+    {
+        /* width, height and maximum value, with whitespace and comments in between, and one whitespace character before the pixels */
+        unsigned int values[3];
+        size_t pos = 2;
+        for (int i = 0; i < 3; ++i)
+        {
+            for (;;)
+            {
+                while (pos < size && isPnmSpace(data[pos])) ++pos;
+                if (pos >= size || data[pos] != '#') break;
+                while (pos < size && data[pos] != '\n' && data[pos] != '\r') ++pos;
+            }
+            values[i] = 0;
+            while (pos < size && data[pos] >= '0' && data[pos] <= '9' && values[i] < 0x10000000) values[i] = values[i] * 10 + (data[pos++] - '0');
+        }
+        if (values[0] != (unsigned int)w || values[1] != (unsigned int)h || values[2] > 255) return 0;
+        raw->offset = pos + 1;
+        raw->channels = (data[1] == '6' ? 3 : 1);
+        rowLength = (size_t)w * raw->channels;
+    }
+    else if (size >= 54 && data[0] == 'B' && data[1] == 'M')
+    {
+        /* only 24 and 32 bits per pixel without bit fields, and for 32 bits the masks of stb_image's fast path */
+        const uint32_t offset = readLE(data + 10, 4), headerSize = readLE(data + 14, 4);
+        const int32_t fileW = (int32_t)readLE(data + 18, 4), fileH = (int32_t)readLE(data + 22, 4);
+        const int bitCount = readLE(data + 28, 2);
+        if ((headerSize != 40 && headerSize != 56 && headerSize != 108 && headerSize != 124) || size < 14 + headerSize || offset < 14 + headerSize) return 0;
+        if (readLE(data + 26, 2) != 1 || readLE(data + 30, 4) || (bitCount != 24 && bitCount != 32)) return 0;
+        if (bitCount == 32 && headerSize >= 108
+            && (readLE(data + 54, 4) != 0xff0000 || readLE(data + 58, 4) != 0xff00 || readLE(data + 62, 4) != 0xff || readLE(data + 66, 4) != 0xff000000)) return 0;
+        if (fileW != w || (fileH != h && fileH != -h)) return 0;
+        raw->offset = offset;
+        raw->channels = bitCount / 8;
+        raw->bgr = 1;
+        raw->opaqueIfNoAlpha = (bitCount == 32 && headerSize < 108);
+        rowLength = ((size_t)w * raw->channels + 3) & ~(size_t)3;
+        topDown = (fileH < 0);
+    }
+    else
+    {
+        /* TGA has no signature, so it is only taken for one with the file name and an uncompressed true colour or grey header */
+        const char* extension = strrchr(path, '.');
+        if (!extension || (strcmp(extension, ".tga") && strcmp(extension, ".TGA")) || size < 18) return 0;
+        const int type = data[2], bitCount = data[16];
+        if (data[1] || readLE(data + 5, 2) || !((type == 2 && (bitCount == 24 || bitCount == 32)) || (type == 3 && bitCount == 8))) return 0;
+        if ((int)readLE(data + 12, 2) != w || (int)readLE(data + 14, 2) != h) return 0;
+        raw->offset = 18 + data[0];
+        raw->channels = bitCount / 8;
+        raw->bgr = (raw->channels >= 3);
+        rowLength = (size_t)w * raw->channels;
+        topDown = (data[17] & 0x20);
+    }
+    if (raw->offset > size || (size - raw->offset) / rowLength < (size_t)h) return 0;
+    raw->rowStride = (ptrdiff_t)rowLength;
+    if (!topDown)
+    {
+        raw->offset += (size_t)(h - 1) * rowLength;
+        raw->rowStride = -raw->rowStride;
+    }
+    return 1;
+}
+/* Converts one row the way stb_image does, with the R and RG channels taken as they are for 1 or 2 channels */
+static void convertRawRow(unsigned char* out, const unsigned char* in, const int w, const struct RawImage* raw, const int channels, const int opaque)
+{
+    const int fileChannels = raw->channels;
+    const int r = (raw->bgr ? 2 : 0), b = 2 - r;
+    for (int x = 0; x < w; ++x, in += fileChannels, out += channels)
+    {
+        if (fileChannels == 1)
+        {
+            out[0] = in[0];
+            if (channels == 2) out[1] = in[0];
+            if (channels >= 3) out[1] = out[2] = in[0];
+            if (channels == 4) out[3] = 255;
+            continue;
+        }
+        out[0] = in[r];
+        if (channels >= 2) out[1] = in[1];
+        if (channels >= 3) out[2] = in[b];
+        if (channels == 4) out[3] = (fileChannels == 4 && !opaque ? in[3] : 255);
+    }
+}
+static void releaseInput(struct ConvertJob* job)
+{
+    if (job->fileMapped) unmapFile(job->fileData, job->fileSize);
+    else arenaFree(job->arena, job->fileData);
+}
+static int decodeRaw(struct ConvertJob* job, const struct RawImage* raw)
+{
+    const int w = job->w, h = job->h, channels = job->channels;
+    if (raw->channels == channels && !raw->bgr && raw->rowStride == (ptrdiff_t)w * channels)
+    {
+        /* the file stays mapped until the mipmaps are done with it */
+        job->image = job->fileData + raw->offset;
+        job->imageInFile = 1;
+        return 0;
+    }
+    job->image = arenaAlloc(job->arena, sizeMul(sizeMul(w, h), channels));
+    if (!job->image)
+    {
+        logPrintf("Error: Not enough memory to load file '%s'\n", job->inFilePath);
+        releaseInput(job);
+        return ENOMEM;
+    }
+    int opaque = 0;
+    if (raw->opaqueIfNoAlpha && channels == 4)
+    {
+        opaque = 1;
+        for (int y = 0; y < h && opaque; ++y)
+        {
+            const unsigned char* in = job->fileData + raw->offset + y * raw->rowStride;
+            for (int x = 0; x < w; ++x) opaque &= !in[x * 4 + 3];
+        }
+    }
+    for (int y = 0; y < h; ++y) convertRawRow(job->image + (size_t)y * w * channels, job->fileData + raw->offset + y * raw->rowStride, w, raw, channels, opaque);
+    releaseInput(job);
+    return 0;
+}
+static void releaseImage(struct ConvertJob* job)
+{
+    if (job->imageInFile) releaseInput(job);
+    else stbi_image_free(job->image);
+}
+
+/* In a batch, every image goes through these stages in turn. Each stage has threads of its own and a bounded queue of the
+   images waiting for it, and a stage whose next queue is full waits before it takes on another image. That way reading and
+   decoding the next images overlaps with making the mipmaps of this one, but decoded images don't pile up if that falls behind.
+   Each stage returns 0 or an error code; an image that fails skips the stages after it. */
+static int readInput(struct ConvertJob* job)
+{
+    logPrintf("Loading file '%s'...\n", job->inFilePath);
+    arenaBegin(job->arena, job->memoryEstimate);
+    if (job->fileRead) return 0;    /* already read by probeImage, and freed like any other memory outside the arena */
+    /* stb_image decodes straight from the page cache if the file can be mapped; otherwise it is read into the arena */
+    job->fileData = mapFile(job->inFilePath, &job->fileSize);
+    job->fileMapped = (job->fileData != NULL);
+    if (job->fileMapped) return 0;
+    FILE* inputFile = fopen(job->inFilePath, "rb");
+    job->fileData = (inputFile ? arenaAlloc(job->arena, job->fileSize) : NULL);
+    if (!inputFile || !job->fileData || fread(job->fileData, 1, job->fileSize, inputFile) != job->fileSize)
+    {
+        const int error = (!inputFile || ferror(inputFile) ? errno : job->fileData ? EIO : ENOMEM);
+        logPrintf("Error: Failed to read file '%s': %s\n", job->inFilePath, strerror(error));
+        if (inputFile) fclose(inputFile);
+        arenaFree(job->arena, job->fileData);
+        return error;
+    }
+    fclose(inputFile);
+    return 0;
+}
+static int decodeInput(struct ConvertJob* job)
+{
+    /* The decoded image is used as the first mip level as it is */
     int w, h;
-	stbi_uc *loadedFileData = stbi_load(inFilePath, &w, &h, (channels == 0 ? &channels : NULL), 4);
-    if (!loadedFileData)
+    struct RawImage raw;
+    if (parseRawImage(job->fileData, job->fileSize, job->inFilePath, job->w, job->h, &raw)) return decodeRaw(job, &raw);
+    job->image = loadFromMemory(job->fileData, job->fileSize, &w, &h, job->loadChannels);
+    releaseInput(job);
+    if (!job->image || w != job->w || h != job->h)
     {
-        printf("Error: Failed to load file '%s': %s\n", inFilePath, stbi_failure_reason());
+        logPrintf("Error: Failed to load file '%s': %s\n", job->inFilePath, (job->image ? "file changed while converting" : stbi_failure_reason()));
+        stbi_image_free(job->image);
         return 1;
     }
-    assert(channels >= 1 && channels <= 4);
-
-    /* generate output file name */
+    if (job->loadChannels != job->channels)
+    {
+        const size_t pixelCount = (size_t)w * h;
+        for (size_t i = 0; i < pixelCount; ++i) memmove(job->image + i * job->channels, job->image + i * job->loadChannels, job->channels);
+    }
+    if (job->greyToRG)
+    {
+        const size_t pixelCount = (size_t)w * h;
+        for (size_t i = 0; i < pixelCount; ++i) job->image[i * 2 + 1] = job->image[i * 2];
+    }
+    return 0;
+}
+static int generateMips(struct ConvertJob* job)
+{
+    const double startTime = currentSeconds();
+    const struct Options* options = job->options;
+    struct MipJob mipJob;
+    const int result = startMips(&mipJob, &job->mips, job->w, job->h, options->allowGenMips, job->channels, options->mode, options->layout, &options->filter, job->image, job->arena, job->lowMemory);
+    if (result)
+    {
+        releaseImage(job);
+        return result;
+    }
+    /* the writer takes the levels as they are done, while this thread helps compressing the rest */
+    stagePush(&batch.stages[STAGE_WRITE], job);
+    finishMips(&mipJob);
+    releaseImage(job);
+    mutexLock(&pool.mutex);
+    job->mips.seconds = currentSeconds() - startTime;
+    job->mips.finished = 1;
+    condBroadcast(&job->mips.progress);
+    mutexUnlock(&pool.mutex);
+    return 0;
+}
+/* Waits until the first levels of the mipmaps are compressed, or with levelCount until they are finished; returns the seconds
+   that took */
+static double waitForMips(struct CompressedMips* mips, const int levelCount)
+{
+    const double startTime = currentSeconds();
+    mutexLock(&pool.mutex);
+    while (levelCount < mips->levelCount ? mips->levelsDone < levelCount : !mips->finished) condWait(&mips->progress, &pool.mutex);
+    mutexUnlock(&pool.mutex);
+    return currentSeconds() - startTime;
+}
+/* The input file name with .dds instead of its extension, which is where the output goes unless -o is given */
+static char* defaultOutputPath(struct Arena* arena, const char* inFilePath)
+{
     const char* periodPos = strrchr(inFilePath, '.');   /* get position of last period in string */
     if (!periodPos) periodPos = inFilePath + strlen(inFilePath);    /* point to end in case of no period, though it would be an unusual scenario */
     int periodOffset = periodPos - inFilePath;
-    char* outFilePath = malloc(periodOffset + 5);
+    char* outFilePath = arenaAlloc(arena, periodOffset + 5);
+    if (!outFilePath) return NULL;
     memcpy(outFilePath, inFilePath, periodOffset);
     memcpy(outFilePath + periodOffset, ".dds", 5);
+    return outFilePath;
+}
+static int writeOutput(struct ConvertJob* job)
+{
+    /* generate output file name, unless one was given */
+    const char* givenPath = job->options->outFilePath;
+    char* outFilePath = (givenPath ? NULL : defaultOutputPath(job->arena, job->inFilePath));
+    const char* finalPath = (givenPath ? givenPath : outFilePath);
+    const int toStdout = (givenPath && !strcmp(givenPath, "-"));
+    /* The file is written under a temporary name and only renamed once it is complete, so that an interrupted conversion
+       never leaves behind a truncated file under the final name */
+    const size_t finalLength = (finalPath ? strlen(finalPath) : 0);
+    char* tempPath = (finalPath && !toStdout ? arenaAlloc(job->arena, finalLength + 5) : NULL);
+    struct CompressedMips* mips = &job->mips;
+    double waited = 0;
+    FILE* outputFile = NULL;
+    int error = 0;
+    const int named = (finalPath && (toStdout || tempPath));
+    if (!named)
+    {
+        logPrintf("Error: Not enough memory to name the output file of '%s'\n", job->inFilePath);
+        error = ENOMEM;
+    }
+    else
+    {
+        if (tempPath)
+        {
+            memcpy(tempPath, finalPath, finalLength);
+            memcpy(tempPath + finalLength, ".tmp", 5);
+        }
+        /* open output file */
+        logPrintf("Opening output file...\n");
+        outputFile = (toStdout ? stdout : fopen(tempPath, "wb"));
+        if (toStdout) setBinaryMode(stdout);
+        if (!outputFile) error = errno;
+    }
+
+    /* every level is written as soon as it is compressed, in the order of the file; after a failed write,
+       the rest are only waited for */
+    if (outputFile)
+    {
+        logPrintf("Writing data...\n");
+        writeHeader(outputFile, job->w, job->h, job->channels, mips->levelCount);
+        if (ferror(outputFile)) error = EIO;
+        for (int i = 0; i < mips->levelCount; ++i)
+        {
+            waited += waitForMips(mips, i + 1);
+            const size_t levelStart = (i ? mips->levelEnds[i - 1] : 0), levelSize = mips->levelEnds[i] - levelStart;
+            errno = 0;
+            /* a single call, as fwrite takes a size_t */
+            if (!error && fwrite(mips->data + levelStart, 1, levelSize, outputFile) != levelSize) error = (errno ? errno : EIO);
+        }
+        if (mips->error)
+        {
+            logPrintf("Error: Not enough memory to generate the mipmaps\n");
+            error = mips->error;
+        }
+        else if (!error && (fflush(outputFile) || (job->options->syncOutput && !toStdout && syncFile(outputFile)))) error = errno;
+        if (!toStdout && fclose(outputFile) && !error) error = errno;
+        if (!toStdout && !error && replaceFile(tempPath, finalPath)) error = errno;
+        if (!toStdout && error) remove(tempPath);
+    }
+    /* the arena can only be handed on once the mipmaps are done with it */
+    waited += waitForMips(mips, mips->levelCount);
+    arenaFree(job->arena, tempPath);
+    arenaFree(job->arena, outFilePath);
+    arenaFree(job->arena, mips->data);
+    job->seconds += mips->seconds - waited;
+    if (error)
+    {
+        if (named) logPrintf("Error: Failed to %s output file: %s\n", (outputFile ? "write" : "open"), strerror(error));
+        return error;
+    }
 
-    /* open output file */
-    printf("Opening output file...\n");
-    FILE* outputFile = fopen(outFilePath, "wb");
+    logPrintf("Success.\n");
+    return 0;
+}
+
+/* A journal line names an input file, its output file and the options that the output depends on, separated by tabs, so that
+   the same input is converted again for another output or format. Stdin, stdout and pipes are never journaled, as a later run
+   can't tell whether they are the same. Returns the line as a malloc'd string without the line break, or NULL. */
+static char* journalEntry(const char* inFilePath, const struct Options* options)
+{
+    static const char* const formatNames[] = { "auto", "bc4", "bc5", "bc1", "bc3" };
+    if (!strcmp(inFilePath, "-") || (options->outFilePath && !strcmp(options->outFilePath, "-"))) return NULL;
+    char* outFilePath = (options->outFilePath ? NULL : defaultOutputPath(NULL, inFilePath));
+    const char* finalPath = (options->outFilePath ? options->outFilePath : outFilePath);
+    char* entry = NULL;
+    if (finalPath)
+    {
+        const char* mips = (options->allowGenMips ? mipFilterNames[options->filter.type] : "nomip");
+        const char* fast = (options->mode & STB_DXT_HIGHQUAL ? "" : " fast");
+        const char* noDither = (options->mode & STB_DXT_DITHER ? "" : " nodither");
+        const char* format = "%s\t%s\t%s %s%s%s";
+        const int length = snprintf(NULL, 0, format, inFilePath, finalPath, formatNames[options->channels], mips, fast, noDither);
+        entry = malloc(length + 1);
+        if (entry) snprintf(entry, length + 1, format, inFilePath, finalPath, formatNames[options->channels], mips, fast, noDither);
+    }
     free(outFilePath);
-    if (!outputFile)
+    return entry;
+}
+static void finishJob(struct ConvertJob* job)
+{
+    logPrintf("'%s' took %.2f s (estimated: %.2f s)\n", job->inFilePath, job->seconds, job->timeEstimate);
+    char* entry = (!job->result && batch.journal && !job->fileRead ? journalEntry(job->inFilePath, job->options) : NULL);
+    if (entry)
     {
-        printf("Error: Failed to open output file: %s\n", strerror(errno));
-        stbi_image_free(loadedFileData);
-        return errno;
+        mutexLock(&pool.mutex);
+        fprintf(batch.journal, "%s\n", entry);
+        fflush(batch.journal);
+        if (job->options->syncOutput) syncFile(batch.journal);
+        mutexUnlock(&pool.mutex);
+        free(entry);
     }
 
-    /* generate mipmaps */
-    int mipCount;
-    unsigned char* mipData = genMips(w, h, allowGenMips, channels >= 3, loadedFileData, &mipCount);
-    stbi_image_free(loadedFileData);    /* Free original image here since we don't need it anymore */
+    /* with a budget, idle arenas give their memory back rather than keeping it mapped for the next image */
+    if (batch.budget != SIZE_MAX) arenaRelease(job->arena);
+    mutexLock(&pool.mutex);
+    job->arena->next = batch.idleArenas;
+    batch.idleArenas = job->arena;
+    batch.memoryInUse -= job->memoryEstimate;
+    --batch.running;
+    condBroadcast(&batch.jobDone);
+    mutexUnlock(&pool.mutex);
+}
+THREAD_FUNC(stageWorker)
+{
+    struct StageQueue* stage = arg;
+    for (;;)
+    {
+        mutexLock(&pool.mutex);
+        while (!stage->count) condWait(&stage->notEmpty, &pool.mutex);
+        struct ConvertJob* job = stage->jobs[stage->first];
+        stage->first = (stage->first + 1) % stage->threadCount;
+        --stage->count;
+        condSignal(&stage->notFull);
+        mutexUnlock(&pool.mutex);
 
-    /* write to output file */
-    writeData(outputFile, w, h, channels, mipCount, mipData);
+        currentArena = job->arena;
+        const double startTime = currentSeconds();
+        const int result = stage->run(job);
+        currentArena = NULL;
+        if (!result && stage->passesOn) continue;   /* the image may be with the next stage already */
+        job->result = result;
+        job->seconds += currentSeconds() - startTime;
+        if (!job->result && stage + 1 < batch.stages + STAGE_COUNT) stagePush(stage + 1, job);
+        else finishJob(job);
+    }
+    return 0;
+}
+/* Sets up the stages with the given number of threads each */
+static void stagesInit(const int* threadCounts)
+{
+    static int (* const stageFuncs[STAGE_COUNT])(struct ConvertJob* job) = { readInput, decodeInput, generateMips, writeOutput };
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        struct StageQueue* stage = &batch.stages[i];
+        stage->run = stageFuncs[i];
+        stage->passesOn = (i == STAGE_MIPS);
+        stage->threadCount = threadCounts[i];
+        condInit(&stage->notEmpty);
+        condInit(&stage->notFull);
+        stage->jobs = calloc(stage->threadCount, sizeof(struct ConvertJob*));
+        for (int t = 0; t < stage->threadCount; ++t) startThread(stageWorker, stage);
+    }
+}
+/* Prefetches the files of the images after the one that is about to be started, up to readAhead of them. Their files have to
+   fit into what is left of the memory budget, as they take up memory in the OS cache until they are converted. */
+static void prefetchInputs(const struct ConvertJob* jobs, const int next, const int count, const int readAhead, int* prefetched)
+{
+    mutexLock(&pool.mutex);
+    const size_t available = budgetLeft();
+    mutexUnlock(&pool.mutex);
+    size_t pending = 0;
+    for (int i = next + 1; i < *prefetched; ++i) pending = sizeAdd(pending, jobs[i].fileSize);
+    if (*prefetched <= next) *prefetched = next + 1;
+    for (; *prefetched < count && *prefetched <= next + readAhead && !jobs[*prefetched].result; ++*prefetched)
+    {
+        pending = sizeAdd(pending, jobs[*prefetched].fileSize);
+        if (pending > available) break;
+        prefetchFile(jobs[*prefetched].inFilePath);
+    }
+}
+/* Starts converting an image once there is room for it; a job that exceeds the budget on its own waits for all others */
+static void startJob(struct ConvertJob* job)
+{
+    mutexLock(&pool.mutex);
+    while (batch.running >= batch.maxJobs || (batch.running && job->memoryEstimate > budgetLeft())) condWait(&batch.jobDone, &pool.mutex);
+    ++batch.running;
+    batch.memoryInUse = sizeAdd(batch.memoryInUse, job->memoryEstimate);
+    if (batch.memoryInUse > batch.peakMemory) batch.peakMemory = batch.memoryInUse;
+    job->arena = batch.idleArenas;
+    if (job->arena) batch.idleArenas = job->arena->next;
+    mutexUnlock(&pool.mutex);
+    if (!job->arena) job->arena = arenaCreate();
+    stagePush(&batch.stages[STAGE_READ], job);
+}
+/* A batch can keep a journal of the input files it has converted, one per line (see journalEntry), so that it can be restarted
+   after it was stopped and skip those. Returns the contents of the journal as a string, or NULL if there is none yet. */
+static char* loadJournal(const char* path)
+{
+    FILE* journalFile = fopen(path, "rb");
+    if (!journalFile) return NULL;
+    fseek64(journalFile, 0, SEEK_END);
+    const size_t size = (size_t)ftell64(journalFile);
+    fseek64(journalFile, 0, SEEK_SET);
+    char* journal = malloc(size + 1);
+    if (journal) journal[fread(journal, 1, size, journalFile)] = '\0';
+    fclose(journalFile);
+    return journal;
+}
+static int journalHas(const char* journal, const char* entry)
+{
+    if (!entry) return 0;
+    const size_t length = strlen(entry);
+    for (const char* line = journal; line && *line; line = strchr(line, '\n'), line = (line ? line + 1 : NULL))
+    {
+        if (!strncmp(line, entry, length) && (line[length] == '\n' || line[length] == '\r')) return 1;
+    }
+    return 0;
+}
 
-    fclose(outputFile);
-    free(mipData);
+/* Parses a byte count with an optional K, M or G suffix; returns 0 if it isn't one */
+static size_t parseByteCount(const char* text)
+{
+    char* end;
+    const unsigned long long count = strtoull(text, &end, 10);
+    const int shift = (*end == 'K' || *end == 'k' ? 10 : *end == 'M' || *end == 'm' ? 20 : *end == 'G' || *end == 'g' ? 30 : 0);
+    if (end == text || (shift && end[1]) || (!shift && *end) || count > (SIZE_MAX >> shift)) return 0;
+    return (size_t)count << shift;
+}
 
-    printf("Success.\n");
+int main(int argc, char** argv)
+{
+    if (argc <= 1)
+    {
+        printHelp();
+        return 0;
+    }
+    
+    /* messages have to stay out of the way if the output goes to stdout, even the ones about the arguments */
+    logFile = stdout;
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-o") && !strcmp(argv[i + 1], "-")) logFile = stderr;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    const char** inFilePaths = malloc(argc * sizeof(char*));
+    int inputCount = 0;
+    struct Options options = { .channels = 0, .allowGenMips = 1, .mode = STB_DXT_DITHER | STB_DXT_HIGHQUAL, .layout = MIP_LAYOUT_BLOCK, .filter = { 0 }, .syncOutput = 0, .outFilePath = NULL };
+    const char* isaName = getenv("EASYDDS_ISA");
+    enum MipFilterType mipFilterType = MIP_FILTER_MITCHELL;
+    int threadCount = cpuCount();
+    int hugePages = 0;
+    int refDecode = 0;
+    int maxJobs = 0;
+    int stageThreads[STAGE_COUNT] = { 1, 1, 1, 1 };
+    int readAhead = 2;
+    const char* journalPath = NULL;
+    size_t memoryBudget = SIZE_MAX;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] == '-' && argv[i][1])
+        {
+            if (!strcmp(argv[i], "-help"))
+            {
+                printHelp();
+                return 0;
+            }
+            else if (!strcmp(argv[i], "-bc1")) options.channels = 3;
+            else if (!strcmp(argv[i], "-bc3")) options.channels = 4;
+            else if (!strcmp(argv[i], "-bc4")) options.channels = 1;
+            else if (!strcmp(argv[i], "-bc5")) options.channels = 2;
+            else if (!strcmp(argv[i], "-nomip")) options.allowGenMips = 0;
+            else if (!strcmp(argv[i], "-linearmips")) options.layout = MIP_LAYOUT_LINEAR;
+            else if (!strcmp(argv[i], "-nodither")) options.mode &= ~STB_DXT_DITHER;
+            else if (!strcmp(argv[i], "-fast")) options.mode &= ~STB_DXT_HIGHQUAL;
+            else if (!strcmp(argv[i], "-hugepages")) hugePages = 1;
+            else if (!strcmp(argv[i], "-jobs") && i + 1 < argc)
+            {
+                maxJobs = atoi(argv[++i]);
+                if (maxJobs < 1)
+                {
+                    logPrintf("Error: '%s' is not a valid number of jobs\n", argv[i]);
+                    return EINVAL;
+                }
+            }
+            else if (!strcmp(argv[i], "-o") && i + 1 < argc) options.outFilePath = argv[++i];
+            else if (!strcmp(argv[i], "-fsync")) options.syncOutput = 1;
+            else if (!strcmp(argv[i], "-journal") && i + 1 < argc) journalPath = argv[++i];
+            else if (!strcmp(argv[i], "-readahead") && i + 1 < argc)
+            {
+                readAhead = atoi(argv[++i]);
+                if (readAhead < 0)
+                {
+                    logPrintf("Error: '%s' is not a valid number of files to read ahead\n", argv[i]);
+                    return EINVAL;
+                }
+            }
+            else if (!strcmp(argv[i], "-stages") && i + 1 < argc)
+            {
+                char extra;
+                ++i;
+                if (sscanf(argv[i], "%i,%i,%i,%i%c", &stageThreads[0], &stageThreads[1], &stageThreads[2], &stageThreads[3], &extra) != STAGE_COUNT
+                    || stageThreads[0] < 1 || stageThreads[1] < 1 || stageThreads[2] < 1 || stageThreads[3] < 1)
+                {
+                    logPrintf("Error: '%s' is not a valid thread count for each of the %s, %s, %s and %s stages\n", argv[i], stageNames[0], stageNames[1], stageNames[2], stageNames[3]);
+                    return EINVAL;
+                }
+            }
+            else if (!strcmp(argv[i], "-membudget") && i + 1 < argc)
+            {
+                memoryBudget = parseByteCount(argv[++i]);
+                if (!memoryBudget)
+                {
+                    logPrintf("Error: '%s' is not a valid memory budget\n", argv[i]);
+                    return EINVAL;
+                }
+            }
+            else if (!strcmp(argv[i], "-isa") && i + 1 < argc) isaName = argv[++i];
+            else if (!strcmp(argv[i], "-refdecode")) refDecode = 1;
+            else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+            {
+                threadCount = atoi(argv[++i]);
+                if (threadCount < 1)
+                {
+                    logPrintf("Error: '%s' is not a valid number of threads\n", argv[i]);
+                    return EINVAL;
+                }
+            }
+            else if (!strcmp(argv[i], "-mipfilter") && i + 1 < argc)
+            {
+                ++i;
+                int f = 0;
+                const int filterCount = (int)(sizeof(mipFilterNames) / sizeof(mipFilterNames[0]));
+                while (f < filterCount && strcmp(argv[i], mipFilterNames[f])) ++f;
+                if (f == filterCount)
+                {
+                    logPrintf("Error: '%s' is not a known mipmap filter\n", argv[i]);
+                    return EINVAL;
+                }
+                mipFilterType = (enum MipFilterType)f;
+            }
+            else 
+            {
+                logPrintf("Error: '%s' is not a known argument\n", argv[i]);
+                return EINVAL;
+            }
+        }
+        else inFilePaths[inputCount++] = argv[i];
+    }
+    if (!inputCount)
+    {
+        logPrintf("Error: No input file given\n");
+        return 1;
+    }
+    if (options.outFilePath && inputCount > 1)
+    {
+        logPrintf("Error: -o can only be used with a single input file\n");
+        return EINVAL;
+    }
+    for (int i = 0; i < inputCount; ++i)
+    {
+        if (!strcmp(inFilePaths[i], "-") && !options.outFilePath)
+        {
+            logPrintf("Error: Input from stdin needs an output file given with -o\n");
+            return EINVAL;
+        }
+    }
+    if (!selectKernels(isaName)) return EINVAL;
+    logPrintf("Using %s kernels\n", kernels->name);
+    /* The decoder's own fast paths, the SSE2 PNG unfilter among them, are switched by -refdecode and deliberately not by -isa:
+       stb_image checks for SSE2 itself, and every kernel set above runs on SSE2, so there is nothing for -isa to choose there */
+    stbi_zlib_set_fast_inflate(!refDecode);
+    stbi_set_png_simd_unfilter(!refDecode);
+    stbi_set_jpeg_parallel((refDecode || threadCount == 1 ? NULL : parallelFor), threadCount);
+    poolInit(threadCount);
+    arenaHugePages = hugePages;
+    {
+        /* stb_dxt sets up its tables on first use, which must not happen on several threads at once */
+        unsigned char block[16 * 4] = { 0 }, bc[16];
+        stb_compress_dxt_block(bc, block, 0, STB_DXT_NORMAL);
+    }
+    initMipFilter(&options.filter, mipFilterType);
+    if (journalPath)
+    {
+        /* leave out what the journal lists as converted, and add to it from now on */
+        char* journal = loadJournal(journalPath);
+        int remaining = 0;
+        for (int i = 0; i < inputCount; ++i)
+        {
+            char* entry = journalEntry(inFilePaths[i], &options);
+            if (!journalHas(journal, entry)) inFilePaths[remaining++] = inFilePaths[i];
+            free(entry);
+        }
+        if (remaining < inputCount) logPrintf("Skipping %i files that the journal lists as converted\n", inputCount - remaining);
+        inputCount = remaining;
+        free(journal);
+        batch.journal = fopen(journalPath, "ab");
+        if (!batch.journal)
+        {
+            const int error = errno;
+            logPrintf("Error: Failed to open journal '%s': %s\n", journalPath, strerror(error));
+            return error;
+        }
+    }
+
+    /* probe all inputs from their headers first, so that they can be converted longest first, several at a time if allowed;
+       a failed one doesn't stop the rest of the batch */
+    condInit(&batch.jobDone);
+    if (!maxJobs)
+    {
+        /* by default, enough images to keep every stage busy */
+        for (int i = 0; i < STAGE_COUNT; ++i) maxJobs += stageThreads[i];
+        if (maxJobs > inputCount) maxJobs = inputCount;
+    }
+    batch.maxJobs = maxJobs;
+    stagesInit(stageThreads);
+    batch.budget = memoryBudget;
+    struct ConvertJob* jobs = calloc(inputCount, sizeof(struct ConvertJob));
+    int result = 0, failed = 0;
+    for (int i = 0; i < inputCount; ++i)
+    {
+        jobs[i].inFilePath = inFilePaths[i];
+        jobs[i].options = &options;
+        jobs[i].index = i;
+        jobs[i].result = probeImage(&jobs[i], memoryBudget);
+    }
+    qsort(jobs, inputCount, sizeof(struct ConvertJob), compareJobs);
+    int prefetched = 0;
+    for (int i = 0; i < inputCount && !jobs[i].result; ++i)
+    {
+        /* while this one waits for room, the files of the next ones can already be read in */
+        prefetchInputs(jobs, i, inputCount, readAhead, &prefetched);
+        startJob(&jobs[i]);
+    }
+    mutexLock(&pool.mutex);
+    while (batch.running) condWait(&batch.jobDone, &pool.mutex);
+    mutexUnlock(&pool.mutex);
+    for (int i = 0; i < inputCount; ++i)
+    {
+        if (jobs[i].result) result = jobs[i].result, ++failed;
+    }
+    if (inputCount > 1) logPrintf("Converted %i of %i files.\n", inputCount - failed, inputCount);
+    logPrintf("Peak memory use: %zu MiB (estimated: %zu MiB)\n", peakMemoryUse() >> 20, batch.peakMemory >> 20);
+    free(jobs);
+    free(inFilePaths);
+
+    return result;
+}
@@ -0,0 +1,531 @@
+/*
+    Copyright © 2019-2020 daigennki (@daigennki)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+/*
+    Hot kernels of EasyDDS. easydds.c includes this file once per instruction set it dispatches between, with:
+    EASYDDS_KERNEL(name)    giving every function and the kernel table an ISA-specific name
+    EASYDDS_KERNEL_NAME     the name of the instruction set, as accepted by -isa
+    EASYDDS_TARGET          the function attribute that lets the compiler use the instruction set
+    EASYDDS_KERNEL_AVX2     1 if AVX2 code paths may be used, otherwise 0
+    EASYDDS_KERNEL_AVX512   1 if AVX-512 (F, BW and VL) code paths may be used, otherwise 0; implies EASYDDS_KERNEL_AVX2
+*/
+
+/* Gathers one row of 4x4 blocks from (up to) four scanlines of a mip level with `channels` bytes per pixel into encoder-ready block order.
+   Every block in outBlocks is 16 pixels of pixBufStride bytes in row-major order. Pixels beyond the right or bottom edge repeat the last column or row. */
+static EASYDDS_TARGET void EASYDDS_KERNEL(gatherBlockRow)(unsigned char* outBlocks, const stbi_uc* inRow, const int mw, const int rows, const int channels, const int pixBufStride)
+{
+    const int blockBytes = 16 * pixBufStride;
+    const int rowStride = mw * channels;
+    int x = 0;
+    if (rows == 4)
+    {
+        const stbi_uc* r0 = inRow;
+        const stbi_uc* r1 = inRow + rowStride;
+        const stbi_uc* r2 = inRow + rowStride * 2;
+        const stbi_uc* r3 = inRow + rowStride * 3;
+        switch (channels)
+        {
+#ifdef STBI_SSE2
+        /* full blocks: load 16 bytes per scanline and transpose them into blocks in registers */
+        case 4:
+            for (; x + 4 <= mw; x += 4, outBlocks += 64)
+            {
+                _mm_storeu_si128((__m128i*)outBlocks, _mm_loadu_si128((const __m128i*)(r0 + x * 4)));
+                _mm_storeu_si128((__m128i*)outBlocks + 1, _mm_loadu_si128((const __m128i*)(r1 + x * 4)));
+                _mm_storeu_si128((__m128i*)outBlocks + 2, _mm_loadu_si128((const __m128i*)(r2 + x * 4)));
+                _mm_storeu_si128((__m128i*)outBlocks + 3, _mm_loadu_si128((const __m128i*)(r3 + x * 4)));
+            }
+            break;
+        case 2:     /* two blocks per load */
+            for (; x + 8 <= mw; x += 8, outBlocks += 64)
+            {
+                const __m128i a = _mm_loadu_si128((const __m128i*)(r0 + x * 2)), b = _mm_loadu_si128((const __m128i*)(r1 + x * 2));
+                const __m128i c = _mm_loadu_si128((const __m128i*)(r2 + x * 2)), d = _mm_loadu_si128((const __m128i*)(r3 + x * 2));
+                _mm_storeu_si128((__m128i*)outBlocks, _mm_unpacklo_epi64(a, b));
+                _mm_storeu_si128((__m128i*)outBlocks + 1, _mm_unpacklo_epi64(c, d));
+                _mm_storeu_si128((__m128i*)outBlocks + 2, _mm_unpackhi_epi64(a, b));
+                _mm_storeu_si128((__m128i*)outBlocks + 3, _mm_unpackhi_epi64(c, d));
+            }
+            break;
+        case 1:     /* four blocks per load */
+#if EASYDDS_KERNEL_AVX512
+            for (; x + 64 <= mw; x += 64, outBlocks += 256)     /* sixteen blocks per load; each 128-bit lane ends up with one block of every output vector, so transpose the lanes */
+            {
+                const __m512i a = _mm512_loadu_si512(r0 + x), b = _mm512_loadu_si512(r1 + x);
+                const __m512i c = _mm512_loadu_si512(r2 + x), d = _mm512_loadu_si512(r3 + x);
+                const __m512i ab0 = _mm512_unpacklo_epi32(a, b), cd0 = _mm512_unpacklo_epi32(c, d);
+                const __m512i ab1 = _mm512_unpackhi_epi32(a, b), cd1 = _mm512_unpackhi_epi32(c, d);
+                const __m512i b0 = _mm512_unpacklo_epi64(ab0, cd0), b1 = _mm512_unpackhi_epi64(ab0, cd0);
+                const __m512i b2 = _mm512_unpacklo_epi64(ab1, cd1), b3 = _mm512_unpackhi_epi64(ab1, cd1);
+                const __m512i lo01 = _mm512_shuffle_i64x2(b0, b1, 0x44), hi01 = _mm512_shuffle_i64x2(b0, b1, 0xee);
+                const __m512i lo23 = _mm512_shuffle_i64x2(b2, b3, 0x44), hi23 = _mm512_shuffle_i64x2(b2, b3, 0xee);
+                _mm512_storeu_si512(outBlocks, _mm512_shuffle_i64x2(lo01, lo23, 0x88));
+                _mm512_storeu_si512(outBlocks + 64, _mm512_shuffle_i64x2(lo01, lo23, 0xdd));
+                _mm512_storeu_si512(outBlocks + 128, _mm512_shuffle_i64x2(hi01, hi23, 0x88));
+                _mm512_storeu_si512(outBlocks + 192, _mm512_shuffle_i64x2(hi01, hi23, 0xdd));
+            }
+#endif
+#if EASYDDS_KERNEL_AVX2
+            for (; x + 32 <= mw; x += 32, outBlocks += 128)     /* eight blocks per load; unpacks work within 128-bit lanes, so swap the middle blocks back afterwards */
+            {
+                const __m256i a = _mm256_loadu_si256((const __m256i*)(r0 + x)), b = _mm256_loadu_si256((const __m256i*)(r1 + x));
+                const __m256i c = _mm256_loadu_si256((const __m256i*)(r2 + x)), d = _mm256_loadu_si256((const __m256i*)(r3 + x));
+                const __m256i ab0 = _mm256_unpacklo_epi32(a, b), cd0 = _mm256_unpacklo_epi32(c, d);
+                const __m256i ab1 = _mm256_unpackhi_epi32(a, b), cd1 = _mm256_unpackhi_epi32(c, d);
+                const __m256i b04 = _mm256_unpacklo_epi64(ab0, cd0), b15 = _mm256_unpackhi_epi64(ab0, cd0);
+                const __m256i b26 = _mm256_unpacklo_epi64(ab1, cd1), b37 = _mm256_unpackhi_epi64(ab1, cd1);
+                _mm256_storeu_si256((__m256i*)outBlocks, _mm256_permute2x128_si256(b04, b15, 0x20));
+                _mm256_storeu_si256((__m256i*)outBlocks + 1, _mm256_permute2x128_si256(b26, b37, 0x20));
+                _mm256_storeu_si256((__m256i*)outBlocks + 2, _mm256_permute2x128_si256(b04, b15, 0x31));
+                _mm256_storeu_si256((__m256i*)outBlocks + 3, _mm256_permute2x128_si256(b26, b37, 0x31));
+            }
+#endif
+            for (; x + 16 <= mw; x += 16, outBlocks += 64)
+            {
+                const __m128i a = _mm_loadu_si128((const __m128i*)(r0 + x)), b = _mm_loadu_si128((const __m128i*)(r1 + x));
+                const __m128i c = _mm_loadu_si128((const __m128i*)(r2 + x)), d = _mm_loadu_si128((const __m128i*)(r3 + x));
+                const __m128i ab0 = _mm_unpacklo_epi32(a, b), cd0 = _mm_unpacklo_epi32(c, d);
+                const __m128i ab1 = _mm_unpackhi_epi32(a, b), cd1 = _mm_unpackhi_epi32(c, d);
+                _mm_storeu_si128((__m128i*)outBlocks, _mm_unpacklo_epi64(ab0, cd0));
+                _mm_storeu_si128((__m128i*)outBlocks + 1, _mm_unpackhi_epi64(ab0, cd0));
+                _mm_storeu_si128((__m128i*)outBlocks + 2, _mm_unpacklo_epi64(ab1, cd1));
+                _mm_storeu_si128((__m128i*)outBlocks + 3, _mm_unpackhi_epi64(ab1, cd1));
+            }
+            break;
+#endif
+        case 3:     /* expand RGB to RGBA with constant alpha, which stb_compress_dxt_block expects for BC1 */
+#if EASYDDS_KERNEL_AVX2
+            {
+                /* pshufb spreads 4 RGB pixels out to RGBA; each 16-byte load reads 4 bytes past the block, so leave room for that */
+                const __m128i rgbToRgba = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+                const __m128i alphaOne = _mm_set1_epi32((int)0xff000000);
+                for (; x + 6 <= mw; x += 4, outBlocks += 64)
+                {
+                    _mm_storeu_si128((__m128i*)outBlocks, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r0 + x * 3)), rgbToRgba), alphaOne));
+                    _mm_storeu_si128((__m128i*)outBlocks + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r1 + x * 3)), rgbToRgba), alphaOne));
+                    _mm_storeu_si128((__m128i*)outBlocks + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r2 + x * 3)), rgbToRgba), alphaOne));
+                    _mm_storeu_si128((__m128i*)outBlocks + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r3 + x * 3)), rgbToRgba), alphaOne));
+                }
+            }
+#endif
+            for (; x + 4 <= mw; x += 4, outBlocks += 64)
+            {
+                const stbi_uc* inRows[4] = { r0 + x * 3, r1 + x * 3, r2 + x * 3, r3 + x * 3 };
+                uint32_t* outPix = (uint32_t*)outBlocks;
+                for (int i = 0; i < 16; ++i)
+                {
+                    const stbi_uc* p = inRows[i / 4] + (i % 4) * 3;
+                    outPix[i] = p[0] | (p[1] << 8) | (p[2] << 16) | 0xff000000u;
+                }
+            }
+            break;
+        }
+    }
+    /* partial edge blocks, and whatever is left over after the full blocks; pixels past the edges repeat the last ones so that
+       they don't pull the block's endpoints away from the colors that are actually there */
+    for (; x < mw; x += 4, outBlocks += blockBytes)
+    {
+        for (int i = 0; i < 4; ++i)     /* every row in the 4x4 pixel block */
+        {
+            const stbi_uc* inPixRow = inRow + (i < rows ? i : rows - 1) * rowStride;
+            unsigned char* outPix = outBlocks + i * 4 * pixBufStride;
+            for (int k = 0; k < 4; ++k, outPix += pixBufStride)
+            {
+                memcpy(outPix, inPixRow + (x + k < mw ? x + k : mw - 1) * channels, channels);
+                if (channels == 3) outPix[3] = 255;
+            }
+        }
+    }
+}
+/* Gathers and encodes block rows y0 to y1 of a mip level into outBlocks; y0 must be a multiple of 4. This is only ever called
+   by the encodeBand* specializations below with constant channels and mode, so the per-block format checks and stb_dxt's mode
+   tests fold away in each of them. */
+static EASYDDS_TARGET EASYDDS_FORCEINLINE void EASYDDS_KERNEL(encodeBand)(unsigned char* outBlocks, const unsigned char* inMip, const int mw, const int mh, const int y0, const int y1, const enum MipLayout layout, unsigned char* blockRow, const int channels, const int mode)
+{
+    const int blockSize = (channels == 2 || channels == 4 ? 16 : 8);
+    const int pixBufStride = (channels == 3 ? 4 : channels);    /* stb_compress_dxt_block expects RGBA even for no alpha */
+    const int blocksPerRow = (mw + 3) / 4;
+    const unsigned char* rgbaBuf = inMip + (size_t)(y0 / 4) * blocksPerRow * 16 * pixBufStride;     /* in block layout, the blocks of a level are simply read in order */
+    unsigned char* bcBuf = outBlocks;
+    for (int y = y0; y < y1; y += 4)    /* every 4 rows */
+    {
+        if (layout == MIP_LAYOUT_LINEAR)
+        {
+            /* gather the whole row of blocks first, rows left over at the bottom are handled by the gather */
+            EASYDDS_KERNEL(gatherBlockRow)(blockRow, inMip + (size_t)y * mw * channels, mw, (mh - y < 4 ? mh - y : 4), channels, pixBufStride);
+            rgbaBuf = blockRow;
+        }
+        for (int x = 0; x < blocksPerRow; ++x, rgbaBuf += 16 * pixBufStride, bcBuf += blockSize)     /* every 4 columns */
+        {
+            switch (channels)
+            {
+            case 3:
+            case 4:
+                stb_compress_dxt_block(bcBuf, rgbaBuf, (channels == 4 ? 1 : 0), mode);
+                break;
+            case 1:
+                stb_compress_bc4_block(bcBuf, rgbaBuf);
+                break;
+            case 2:
+                stb_compress_bc5_block(bcBuf, rgbaBuf);
+                break;
+            }
+        }
+    }
+}
+#define DEFINE_ENCODE_BAND(name, channels, mode) \
+    static EASYDDS_TARGET EASYDDS_FLATTEN void EASYDDS_KERNEL(name)(unsigned char* outBlocks, const unsigned char* inMip, const int mw, const int mh, const int y0, const int y1, const enum MipLayout layout, unsigned char* blockRow) \
+    { \
+        EASYDDS_KERNEL(encodeBand)(outBlocks, inMip, mw, mh, y0, y1, layout, blockRow, channels, mode); \
+    }
+DEFINE_ENCODE_BAND(encodeBandBC1, 3, STB_DXT_NORMAL)
+DEFINE_ENCODE_BAND(encodeBandBC1Dither, 3, STB_DXT_DITHER)
+DEFINE_ENCODE_BAND(encodeBandBC1HighQual, 3, STB_DXT_HIGHQUAL)
+DEFINE_ENCODE_BAND(encodeBandBC1DitherHighQual, 3, STB_DXT_DITHER | STB_DXT_HIGHQUAL)
+DEFINE_ENCODE_BAND(encodeBandBC3, 4, STB_DXT_NORMAL)
+DEFINE_ENCODE_BAND(encodeBandBC3Dither, 4, STB_DXT_DITHER)
+DEFINE_ENCODE_BAND(encodeBandBC3HighQual, 4, STB_DXT_HIGHQUAL)
+DEFINE_ENCODE_BAND(encodeBandBC3DitherHighQual, 4, STB_DXT_DITHER | STB_DXT_HIGHQUAL)
+DEFINE_ENCODE_BAND(encodeBandBC4, 1, STB_DXT_NORMAL)
+DEFINE_ENCODE_BAND(encodeBandBC5, 2, STB_DXT_NORMAL)
+
+/* out[i] = sum over k of weights[k] * (inA[k][i] + inB[k][i]), in the same order for every instruction set so results match exactly */
+static EASYDDS_TARGET EASYDDS_FORCEINLINE void EASYDDS_KERNEL(reduceTaps)(float* out, const float* const* inA, const float* const* inB, const float* weights, const int taps, const int count)
+{
+    int i = 0;
+#if EASYDDS_KERNEL_AVX512
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 sum = _mm512_mul_ps(_mm512_set1_ps(weights[0]), _mm512_add_ps(_mm512_loadu_ps(inA[0] + i), _mm512_loadu_ps(inB[0] + i)));
+        for (int t = 1; t < taps; ++t)
+        {
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_set1_ps(weights[t]), _mm512_add_ps(_mm512_loadu_ps(inA[t] + i), _mm512_loadu_ps(inB[t] + i))));
+        }
+        _mm512_storeu_ps(out + i, sum);
+    }
+#endif
+#if EASYDDS_KERNEL_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_add_ps(_mm256_loadu_ps(inA[0] + i), _mm256_loadu_ps(inB[0] + i)));
+        for (int t = 1; t < taps; ++t)
+        {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_add_ps(_mm256_loadu_ps(inA[t] + i), _mm256_loadu_ps(inB[t] + i))));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#ifdef STBI_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_add_ps(_mm_loadu_ps(inA[0] + i), _mm_loadu_ps(inB[0] + i)));
+        for (int t = 1; t < taps; ++t)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_add_ps(_mm_loadu_ps(inA[t] + i), _mm_loadu_ps(inB[t] + i))));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        float sum = weights[0] * (inA[0][i] + inB[0][i]);
+        for (int t = 1; t < taps; ++t) sum += weights[t] * (inA[t][i] + inB[t][i]);
+        out[i] = sum;
+    }
+}
+/* out[i] = sum over k of weights[k] * in[k][i], in the same order for every instruction set */
+static EASYDDS_TARGET EASYDDS_FORCEINLINE void EASYDDS_KERNEL(sumTaps)(float* out, const float* const* in, const float* weights, const int taps, const int count)
+{
+    int i = 0;
+#if EASYDDS_KERNEL_AVX512
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 sum = _mm512_mul_ps(_mm512_set1_ps(weights[0]), _mm512_loadu_ps(in[0] + i));
+        for (int t = 1; t < taps; ++t) sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_set1_ps(weights[t]), _mm512_loadu_ps(in[t] + i)));
+        _mm512_storeu_ps(out + i, sum);
+    }
+#endif
+#if EASYDDS_KERNEL_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(in[0] + i));
+        for (int t = 1; t < taps; ++t) sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_loadu_ps(in[t] + i)));
+        _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#ifdef STBI_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(in[0] + i));
+        for (int t = 1; t < taps; ++t) sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(in[t] + i)));
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        float sum = weights[0] * in[0][i];
+        for (int t = 1; t < taps; ++t) sum += weights[t] * in[t][i];
+        out[i] = sum;
+    }
+}
+/* Halves a linear-light level in both dimensions with a separable filter; edges are clamped.
+   An even dimension is reduced exactly 2:1 with the fixed, symmetric filter, an odd one (including 1, which stays 1) with the
+   per-pixel weights in oddX or oddY, which are NULL otherwise. Only output rows y0 to y1 are written, which gives the same
+   results as reducing the whole level, and inMip only has to hold the source rows they need, starting at row firstRow.
+   For 2:1, each output row is first filtered vertically, then split into even and odd source pixels per channel so that the
+   horizontal taps are contiguous as well. Returns 0, or ENOMEM if there is no memory for its row buffers. */
+static EASYDDS_TARGET int EASYDDS_KERNEL(reduceMip)(const float* inMip, const int w, const int h, float* outMip, const int mw, const int channels, const struct MipFilter* filter,
+    const struct MipAxisWeights* oddX, const struct MipAxisWeights* oddY, const int firstRow, const int y0, const int y1)
+{
+    const int taps = filter->taps;
+    const int rowLength = w * channels;
+    inMip -= (ptrdiff_t)firstRow * rowLength;
+    const int planeLength = mw + 2 * taps;  /* padded by taps on both sides */
+    float* rowBuf = malloc((rowLength + 2 * channels * planeLength + mw) * sizeof(float));
+    if (!rowBuf) return ENOMEM;
+    float* evenPlanes = rowBuf + rowLength;
+    float* oddPlanes = evenPlanes + channels * planeLength;
+    float* outPlane = oddPlanes + channels * planeLength;
+    const float* inA[MAX_MIP_AXIS_TAPS];
+    const float* inB[MAX_MIP_FILTER_TAPS];
+    outMip += (size_t)y0 * mw * channels;
+    for (int y = y0; y < y1; ++y, outMip += mw * channels)
+    {
+        if (oddY)
+        {
+            for (int t = 0; t < oddY->taps; ++t)
+            {
+                const int row = oddY->first[y] + t;
+                inA[t] = inMip + (size_t)(row < 0 ? 0 : row >= h ? h - 1 : row) * rowLength;
+            }
+            EASYDDS_KERNEL(sumTaps)(rowBuf, inA, oddY->weights + y * oddY->taps, oddY->taps, rowLength);
+        }
+        else
+        {
+            /* vertical: tap t pairs source rows 2y - t and 2y + 1 + t */
+            for (int t = 0; t < taps; ++t)
+            {
+                const int rowA = (2 * y - t < 0 ? 0 : 2 * y - t);
+                const int rowB = (2 * y + 1 + t >= h ? h - 1 : 2 * y + 1 + t);
+                inA[t] = inMip + (size_t)rowA * rowLength;
+                inB[t] = inMip + (size_t)rowB * rowLength;
+            }
+            EASYDDS_KERNEL(reduceTaps)(rowBuf, inA, inB, filter->weights, taps, rowLength);
+        }
+
+        if (oddX)
+        {
+            for (int x = 0; x < mw; ++x)
+            {
+                const float* weights = oddX->weights + x * oddX->taps;
+                for (int c = 0; c < channels; ++c)
+                {
+                    float sum = 0.0f;
+                    for (int t = 0; t < oddX->taps; ++t)
+                    {
+                        const int col = oddX->first[x] + t;
+                        sum += weights[t] * rowBuf[(col < 0 ? 0 : col >= w ? w - 1 : col) * channels + c];
+                    }
+                    outMip[x * channels + c] = sum;
+                }
+            }
+            continue;
+        }
+        for (int c = 0; c < channels; ++c)
+        {
+            /* split into even and odd pixels, padding with the edge pixels */
+            float* even = evenPlanes + c * planeLength + taps;
+            float* odd = oddPlanes + c * planeLength + taps;
+            for (int x = 0; x < mw; ++x)
+            {
+                even[x] = rowBuf[(2 * x) * channels + c];
+                odd[x] = rowBuf[(2 * x + 1) * channels + c];
+            }
+            for (int t = 1; t <= taps; ++t)
+            {
+                even[-t] = odd[-t] = rowBuf[c];
+                even[mw - 1 + t] = odd[mw - 1 + t] = rowBuf[(w - 1) * channels + c];
+            }
+
+            /* horizontal: tap t pairs source pixels 2x - t and 2x + 1 + t */
+            for (int t = 0; t < taps; ++t)
+            {
+                inA[t] = (t % 2 ? odd - (t + 1) / 2 : even - t / 2);
+                inB[t] = (t % 2 ? even + (t + 1) / 2 : odd + t / 2);
+            }
+            EASYDDS_KERNEL(reduceTaps)(outPlane, inA, inB, filter->weights, taps, mw);
+            for (int x = 0; x < mw; ++x) outMip[x * channels + c] = outPlane[x];
+        }
+    }
+    free(rowBuf);
+    return 0;
+}
+
+/* Converts pixels to linear light. With 3 or 4 channels, they are sRGB color, and color is premultiplied by alpha when there are 4;
+   like stb_image_resize, a tiny epsilon is added to alpha so that the color of fully transparent pixels survives.
+   With 1 or 2 channels, they are non-color data and are only scaled to [0, 1]. */
+static EASYDDS_TARGET void EASYDDS_KERNEL(toLinear)(float* out, const stbi_uc* in, const size_t pixelCount, const int channels)
+{
+    const float* lut = stbir__srgb_uchar_to_linear_float;
+    size_t i = 0;
+#if EASYDDS_KERNEL_AVX2
+    /* eight bytes at a time (sixteen with AVX-512), looked up with a gather; that's two (four) pixels with 4 channels */
+    const size_t byteCount = pixelCount * channels;
+    const __m256 maxUint8 = _mm256_set1_ps(255.0f);
+    if (channels == 4)
+    {
+        const __m256 alphaEpsilon = _mm256_set1_ps(STBIR_ALPHA_EPSILON);
+        const __m256i alphaLanes = _mm256_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7);
+#if EASYDDS_KERNEL_AVX512
+        const __m512i alphaLanes16 = _mm512_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+        for (; i + 16 <= byteCount; i += 16)
+        {
+            const __m512i bytes = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+            const __m512 alpha = _mm512_add_ps(_mm512_div_ps(_mm512_cvtepi32_ps(bytes), _mm512_set1_ps(255.0f)), _mm512_set1_ps(STBIR_ALPHA_EPSILON));
+            const __m512 color = _mm512_mul_ps(_mm512_i32gather_ps(bytes, lut, 4), _mm512_permutexvar_ps(alphaLanes16, alpha));
+            _mm512_storeu_ps(out + i, _mm512_mask_blend_ps(0x8888, color, alpha));
+        }
+#endif
+        for (; i + 8 <= byteCount; i += 8)
+        {
+            const __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+            const __m256 alpha = _mm256_add_ps(_mm256_div_ps(_mm256_cvtepi32_ps(bytes), maxUint8), alphaEpsilon);
+            const __m256 color = _mm256_mul_ps(_mm256_i32gather_ps(lut, bytes, 4), _mm256_permutevar8x32_ps(alpha, alphaLanes));
+            _mm256_storeu_ps(out + i, _mm256_blend_ps(color, alpha, 0x88));
+        }
+    }
+    else if (channels == 3)
+    {
+#if EASYDDS_KERNEL_AVX512
+        for (; i + 16 <= byteCount; i += 16)
+        {
+            _mm512_storeu_ps(out + i, _mm512_i32gather_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(in + i))), lut, 4));
+        }
+#endif
+        for (; i + 8 <= byteCount; i += 8)
+        {
+            _mm256_storeu_ps(out + i, _mm256_i32gather_ps(lut, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i))), 4));
+        }
+    }
+    else
+    {
+#if EASYDDS_KERNEL_AVX512
+        for (; i + 16 <= byteCount; i += 16)
+        {
+            _mm512_storeu_ps(out + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(in + i)))), _mm512_set1_ps(255.0f)));
+        }
+#endif
+        for (; i + 8 <= byteCount; i += 8)
+        {
+            _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)))), maxUint8));
+        }
+    }
+    i /= channels;
+#endif
+    for (in += i * channels, out += i * channels; i < pixelCount; ++i, in += channels, out += channels)
+    {
+        switch (channels)
+        {
+        case 4:
+        {
+            const float alpha = in[3] / 255.0f + STBIR_ALPHA_EPSILON;
+            out[0] = lut[in[0]] * alpha;
+            out[1] = lut[in[1]] * alpha;
+            out[2] = lut[in[2]] * alpha;
+            out[3] = alpha;
+            break;
+        }
+        case 3:
+            out[0] = lut[in[0]];
+            out[1] = lut[in[1]];
+            out[2] = lut[in[2]];
+            break;
+        case 2:
+            out[1] = in[1] / 255.0f;
+            /* fall through */
+        case 1:
+            out[0] = in[0] / 255.0f;
+            break;
+        }
+    }
+}
+/* Converts linear-light pixels back to what toLinear took, undoing the alpha premultiplication */
+static EASYDDS_TARGET void EASYDDS_KERNEL(fromLinear)(stbi_uc* out, const float* in, const size_t pixelCount, const int channels)
+{
+    size_t i = 0;
+#if EASYDDS_KERNEL_AVX2
+    /* same table-based conversion as stbir__linear_to_srgb_uchar, eight channels at a time */
+    const size_t byteCount = pixelCount * channels;
+    const __m256 minVal = _mm256_castsi256_ps(_mm256_set1_epi32((127 - 13) << 23)), almostOne = _mm256_castsi256_ps(_mm256_set1_epi32(0x3f7fffff));
+    const __m256i alphaLanes = _mm256_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7);
+    for (; i + 8 <= byteCount; i += 8)
+    {
+        __m256 f = _mm256_loadu_ps(in + i);
+        const __m256 saturated = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        const __m256i unormBytes = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(saturated, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+        __m256i bytes = unormBytes;
+        if (channels >= 3)
+        {
+            if (channels == 4)
+            {
+                const __m256 alpha = _mm256_permutevar8x32_ps(f, alphaLanes);
+                const __m256 recipAlpha = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), alpha), _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+                f = _mm256_mul_ps(f, recipAlpha);
+            }
+            f = _mm256_min_ps(_mm256_max_ps(f, minVal), almostOne);    /* max_ps returns minVal for NaN, like the scalar version */
+            const __m256i u = _mm256_castps_si256(f);
+            const __m256i tab = _mm256_i32gather_epi32((const int*)fp32_to_srgb8_tab4, _mm256_srli_epi32(_mm256_sub_epi32(u, _mm256_castps_si256(minVal)), 20), 4);
+            const __m256i bias = _mm256_slli_epi32(_mm256_srli_epi32(tab, 16), 9);
+            const __m256i scale = _mm256_and_si256(tab, _mm256_set1_epi32(0xffff));
+            const __m256i t = _mm256_and_si256(_mm256_srli_epi32(u, 12), _mm256_set1_epi32(0xff));
+            bytes = _mm256_srli_epi32(_mm256_add_epi32(bias, _mm256_mullo_epi32(scale, t)), 16);
+            if (channels == 4) bytes = _mm256_blend_epi32(bytes, unormBytes, 0x88);
+        }
+        bytes = _mm256_packus_epi16(_mm256_packus_epi32(bytes, bytes), bytes);
+        *(int*)(out + i) = _mm_cvtsi128_si32(_mm256_castsi256_si128(bytes));
+        *(int*)(out + i + 4) = _mm_cvtsi128_si32(_mm256_extracti128_si256(bytes, 1));
+    }
+    i /= channels;
+#endif
+    for (out += i * channels, in += i * channels; i < pixelCount; ++i, in += channels, out += channels)
+    {
+        if (channels <= 2)
+        {
+            for (int c = 0; c < channels; ++c) out[c] = (stbi_uc)(int)(stbir__saturate(in[c]) * 255.0f + 0.5f);
+            continue;
+        }
+        float recipAlpha = 1.0f;
+        if (channels == 4)
+        {
+            const float alpha = in[3];
+            recipAlpha = (alpha != 0 ? 1.0f / alpha : 0);
+            out[3] = (stbi_uc)(int)(stbir__saturate(alpha) * 255.0f + 0.5f);
+        }
+        out[0] = stbir__linear_to_srgb_uchar(in[0] * recipAlpha);
+        out[1] = stbir__linear_to_srgb_uchar(in[1] * recipAlpha);
+        out[2] = stbir__linear_to_srgb_uchar(in[2] * recipAlpha);
+    }
+}
+
+static const struct Kernels EASYDDS_KERNEL(kernels) = {
+    EASYDDS_KERNEL_NAME,
+    EASYDDS_KERNEL(gatherBlockRow),
+    EASYDDS_KERNEL(reduceMip),
+    EASYDDS_KERNEL(toLinear),
+    EASYDDS_KERNEL(fromLinear),
+    /* encodeBand is indexed by [channels - 1][mode]; BC4 and BC5 have no quality modes */
+    {
+        { EASYDDS_KERNEL(encodeBandBC4), EASYDDS_KERNEL(encodeBandBC4), EASYDDS_KERNEL(encodeBandBC4), EASYDDS_KERNEL(encodeBandBC4) },
+        { EASYDDS_KERNEL(encodeBandBC5), EASYDDS_KERNEL(encodeBandBC5), EASYDDS_KERNEL(encodeBandBC5), EASYDDS_KERNEL(encodeBandBC5) },
+        { EASYDDS_KERNEL(encodeBandBC1), EASYDDS_KERNEL(encodeBandBC1Dither), EASYDDS_KERNEL(encodeBandBC1HighQual), EASYDDS_KERNEL(encodeBandBC1DitherHighQual) },
+        { EASYDDS_KERNEL(encodeBandBC3), EASYDDS_KERNEL(encodeBandBC3Dither), EASYDDS_KERNEL(encodeBandBC3HighQual), EASYDDS_KERNEL(encodeBandBC3DitherHighQual) }
+    }
+};
+
+#undef DEFINE_ENCODE_BAND
@@ -300,6 +300,7 @@ RECENT REVISION HISTORY:
 //        STBI_NO_HDR
 //        STBI_NO_PIC
 //        STBI_NO_PNM   (.ppm and .pgm)
+//        STBI_NO_QOI
 //
 //  - You can request *only* certain decoders and suppress all other ones
 //    (this will be more forward-compatible, as addition of new decoders
@@ -314,6 +315,7 @@ RECENT REVISION HISTORY:
 //        STBI_ONLY_HDR
 //        STBI_ONLY_PIC
 //        STBI_ONLY_PNM   (.ppm and .pgm)
+//        STBI_ONLY_QOI
 //
 //   - If you use STBI_NO_PNG (or _ONLY_ without PNG), and you still
 //     want the zlib decoder to be available, #define STBI_SUPPORT_ZLIB
@@ -467,6 +469,10 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
 // or just pass them through "as-is"
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
+// 8-bit RGB and RGBA png scanlines are unfiltered with SSE2 where available;
+// pass 0 to use the plain scalar code instead, which gives the same result
+STBIDEF void stbi_set_png_simd_unfilter(int flag_true_if_should_use_simd);
+
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
@@ -475,6 +481,16 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// let the jpeg decoder spread its work over several threads. run(count, task, arg)
+// must call task(arg, i) once for every i from 0 to count-1, in any order and on
+// any threads, and return once they have all finished; thread_count is how many
+// threads it has. jpegs loaded from memory whose scans have restart markers are
+// entropy decoded in parallel, one run of restart intervals per task, and the
+// IDCT and color conversion of every jpeg is split by rows. pass NULL to decode
+// on the calling thread only, which is the default
+typedef void stbi_parallel_run(int count, void (*task)(void *arg, int index), void *arg);
+STBIDEF void stbi_set_jpeg_parallel(stbi_parallel_run *run, int thread_count);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -485,6 +501,10 @@ STBIDEF int   stbi_zlib_decode_buffer(char *obuffer, int olen, const char *ibuff
 STBIDEF char *stbi_zlib_decode_noheader_malloc(const char *buffer, int len, int *outlen);
 STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen);
 
+// compressed blocks are decoded with a faster inflate by default; pass 0 to
+// use the simple one instead, e.g. to check that both give the same output
+STBIDEF void  stbi_zlib_set_fast_inflate(int flag_true_if_should_use_fast);
+
 
 #ifdef __cplusplus
 }
@@ -500,7 +520,7 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #if defined(STBI_ONLY_JPEG) || defined(STBI_ONLY_PNG) || defined(STBI_ONLY_BMP) \
   || defined(STBI_ONLY_TGA) || defined(STBI_ONLY_GIF) || defined(STBI_ONLY_PSD) \
   || defined(STBI_ONLY_HDR) || defined(STBI_ONLY_PIC) || defined(STBI_ONLY_PNM) \
-  || defined(STBI_ONLY_ZLIB)
+  || defined(STBI_ONLY_QOI) || defined(STBI_ONLY_ZLIB)
    #ifndef STBI_ONLY_JPEG
    #define STBI_NO_JPEG
    #endif
@@ -528,6 +548,9 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
    #ifndef STBI_ONLY_PNM
    #define STBI_NO_PNM
    #endif
+   #ifndef STBI_ONLY_QOI
+   #define STBI_NO_QOI
+   #endif
 #endif
 
 #if defined(STBI_NO_PNG) && !defined(STBI_SUPPORT_ZLIB) && !defined(STBI_NO_ZLIB)
@@ -588,12 +611,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -695,7 +720,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -706,7 +731,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -892,6 +917,12 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
+#ifndef STBI_NO_QOI
+static int      stbi__qoi_test(stbi__context *s);
+static void    *stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static int      stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp);
+#endif
+
 static
 #ifdef STBI_THREAD_LOCAL
 STBI_THREAD_LOCAL
@@ -1076,6 +1107,9 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #ifndef STBI_NO_PNM
    if (stbi__pnm_test(s))  return stbi__pnm_load(s,x,y,comp,req_comp, ri);
    #endif
+   #ifndef STBI_NO_QOI
+   if (stbi__qoi_test(s))  return stbi__qoi_load(s,x,y,comp,req_comp, ri);
+   #endif
 
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
@@ -1523,7 +1557,7 @@ stbi_inline static stbi_uc stbi__get8(stbi__context *s)
    return 0;
 }
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_QOI)
 // nothing
 #else
 stbi_inline static int stbi__at_eof(stbi__context *s)
@@ -1588,7 +1622,7 @@ static int stbi__getn(stbi__context *s, stbi_uc *buffer, int n)
 }
 #endif
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC) && defined(STBI_NO_QOI)
 // nothing
 #else
 static int stbi__get16be(stbi__context *s)
@@ -1598,7 +1632,7 @@ static int stbi__get16be(stbi__context *s)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC) && defined(STBI_NO_QOI)
 // nothing
 #else
 static stbi__uint32 stbi__get32be(stbi__context *s)
@@ -1628,7 +1662,7 @@ static stbi__uint32 stbi__get32le(stbi__context *s)
 
 #define STBI__BYTECAST(x)  ((stbi_uc) ((x) & 255))  // truncate int to byte without warnings
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_QOI)
 // nothing
 #else
 //////////////////////////////////////////////////////////////////////////////
@@ -1648,7 +1682,7 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_QOI)
 // nothing
 #else
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
@@ -2831,8 +2865,156 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+static stbi_parallel_run *stbi__jpeg_parallel = NULL;
+static int stbi__jpeg_parallel_threads = 1;
+
+STBIDEF void stbi_set_jpeg_parallel(stbi_parallel_run *run, int thread_count)
+{
+   stbi__jpeg_parallel = run;
+   stbi__jpeg_parallel_threads = thread_count > 1 ? thread_count : 1;
+}
+
+// how many tasks to split units of work into, with at least min_units in each;
+// a few per thread so that uneven ones even out. 1 means don't bother
+static int stbi__jpeg_parallel_tasks(int units, int min_units)
+{
+   int tasks = stbi__jpeg_parallel_threads * 4;
+   if (!stbi__jpeg_parallel) return 1;
+   if (tasks > units / min_units) tasks = units / min_units;
+   return tasks > 1 ? tasks : 1;
+}
+
+// decode MCUs first..first+count-1 of a baseline scan, starting right after a
+// restart marker (or at the start of the scan), exactly like the loops in
+// stbi__parse_entropy_coded_data do. returns 0 on errors, and 2 where those
+// stop early because a restart marker is missing
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   int m,k,x,y;
+   stbi__jpeg_reset(z);
+   for (m=first; m < first+count; ++m) {
+      if (z->scan_n == 1) {
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3;
+         int i = m % w, j = m / w;
+         int ha = z->img_comp[n].ha;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+      } else {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+               }
+            }
+         }
+      }
+      if (--z->todo <= 0) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         if (!STBI__RESTART(z->marker)) return 2;
+         stbi__jpeg_reset(z);
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z, *last; // last decodes the final chunk, and becomes z afterwards
+   int mcus, chunks, intervals;
+   stbi_uc **start; // where the data of each chunk begins; start[chunks] is the end of the scan's buffer
+   stbi_uc *last_end; // where the last chunk stopped reading
+   int *result;
+} stbi__jpeg_scan_chunks;
+
+static void stbi__jpeg_decode_chunk(void *arg, int index)
+{
+   stbi__jpeg_scan_chunks *c = (stbi__jpeg_scan_chunks *) arg;
+   int first = (int) ((stbi__uint64) c->intervals * index / c->chunks) * c->z->restart_interval;
+   int end = (int) ((stbi__uint64) c->intervals * (index+1) / c->chunks) * c->z->restart_interval;
+   stbi__jpeg copy, *j = index == c->chunks-1 ? c->last : &copy;
+   stbi__context s;
+   if (end > c->mcus) end = c->mcus;
+   *j = *c->z;
+   stbi__start_mem(&s, c->start[index], (int) (c->start[index+1] - c->start[index]));
+   j->s = &s;
+   c->result[index] = stbi__jpeg_decode_mcus(j, first, end - first);
+   if (j == c->last) c->last_end = s.img_buffer;
+}
+
+// restart markers reset the entropy decoder, so the runs of intervals between
+// them can be decoded independently once the markers are found. every chunk
+// but the last has to end at its restart marker just like in the serial
+// decode; if one doesn't, or something fails, this returns 0 without having
+// touched z and the scan is decoded serially, which then treats the problem
+// exactly as before
+static int stbi__jpeg_parse_parallel(stbi__jpeg *z)
+{
+   stbi__context *s = z->s;
+   stbi__jpeg_scan_chunks c;
+   stbi_uc *p = s->img_buffer;
+   int i, chunk, ok = 1;
+
+   if (z->progressive || !z->restart_interval || s->read_from_callbacks || !stbi__jpeg_parallel) return 0;
+   if (z->scan_n == 1)
+      c.mcus = ((z->img_comp[z->order[0]].x+7) >> 3) * ((z->img_comp[z->order[0]].y+7) >> 3);
+   else
+      c.mcus = z->img_mcu_x * z->img_mcu_y;
+   c.intervals = (c.mcus + z->restart_interval - 1) / z->restart_interval;
+   c.chunks = stbi__jpeg_parallel_tasks(c.intervals, 1);
+   if (c.chunks > c.mcus / 64) c.chunks = c.mcus / 64;
+   if (c.chunks < 2) return 0;
+
+   c.z = z;
+   c.last = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg) + (c.chunks+1) * (sizeof(stbi_uc *) + sizeof(int)));
+   if (!c.last) return 0;
+   c.start = (stbi_uc **) (c.last + 1);
+   c.result = (int *) (c.start + c.chunks+1);
+
+   // find the restart markers where the chunks begin, parsing the data like
+   // stbi__grow_buffer_unsafe does: 0xff fill bytes, then 0 for stuffing
+   c.start[0] = p;
+   c.start[c.chunks] = s->img_buffer_end;
+   for (i=1, chunk=1; chunk < c.chunks; ++i) {
+      for (;;) {
+         p = (stbi_uc *) memchr(p, 0xff, s->img_buffer_end - p);
+         if (!p) break;
+         while (p < s->img_buffer_end && *p == 0xff) ++p;
+         if (p == s->img_buffer_end) { p = NULL; break; }
+         if (*p++ != 0) break;
+      }
+      if (!p || !STBI__RESTART(p[-1])) { ok = 0; break; } // a scan that ends early is left to the serial decode
+      // interval i starts after this marker
+      if (i == (int) ((stbi__uint64) c.intervals * chunk / c.chunks))
+         c.start[chunk++] = p;
+   }
+
+   if (ok) {
+      stbi__jpeg_parallel(c.chunks, stbi__jpeg_decode_chunk, &c);
+      for (chunk=0; chunk < c.chunks-1; ++chunk)
+         if (c.result[chunk] != 1) ok = 0;
+      if (!c.result[c.chunks-1]) ok = 0;
+   }
+   if (ok) {
+      // carry on from where the last chunk stopped, in the real stream
+      *z = *c.last;
+      z->s = s;
+      s->img_buffer = c.last_end;
+   }
+   STBI_FREE(c.last);
+   return ok;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
+   if (stbi__jpeg_parse_parallel(z)) return 1;
    stbi__jpeg_reset(z);
    if (!z->progressive) {
       if (z->scan_n == 1) {
@@ -2962,21 +3144,43 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+typedef struct
+{
+   stbi__jpeg *z;
+   int n, rows, tasks;
+} stbi__jpeg_idct_rows;
+
+static void stbi__jpeg_finish_rows(void *arg, int index)
+{
+   stbi__jpeg_idct_rows *c = (stbi__jpeg_idct_rows *) arg;
+   stbi__jpeg *z = c->z;
+   int n = c->n;
+   int w = (z->img_comp[n].x+7) >> 3;
+   int i,j;
+   for (j=c->rows*index/c->tasks; j < c->rows*(index+1)/c->tasks; ++j) {
+      for (i=0; i < w; ++i) {
+         short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+         stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+      }
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
+      // dequantize and idct the data, a band of block rows per task
+      int n;
       for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
+         stbi__jpeg_idct_rows c;
+         c.z = z;
+         c.n = n;
+         c.rows = (z->img_comp[n].y+7) >> 3;
+         c.tasks = stbi__jpeg_parallel_tasks(c.rows, 4);
+         if (c.tasks > 1)
+            stbi__jpeg_parallel(c.tasks, stbi__jpeg_finish_rows, &c);
+         else
+            stbi__jpeg_finish_rows(&c, 0);
       }
    }
 }
@@ -3718,6 +3922,152 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+static void stbi__resample_next_row(stbi__resample *r, int comp_y, int w2)
+{
+   if (++r->ystep >= r->vs) {
+      r->ystep = 0;
+      r->line0 = r->line1;
+      if (++r->ypos < comp_y)
+         r->line1 += w2;
+   }
+}
+
+// resample and color-convert rows j0..j1-1 to output, which starts at row j0;
+// res_comp must be at row j0
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, int n, int decode_n, int is_rgb, unsigned int j0, unsigned int j1)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *out = output + n * z->s->img_x * (j - j0);
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         stbi__resample_next_row(r, z->img_comp[k].y, z->img_comp[k].w2);
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample *res_comp;
+   stbi_uc *output, *linebufs; // linebufs has decode_n line buffers and a row of output per task
+   int n, decode_n, is_rgb, tasks;
+} stbi__jpeg_convert;
+
+static void stbi__jpeg_convert_band(void *arg, int index)
+{
+   stbi__jpeg_convert *c = (stbi__jpeg_convert *) arg;
+   stbi__jpeg *z = c->z;
+   stbi__resample r[4];
+   stbi_uc *linebuf[4];
+   unsigned int j0 = (unsigned int) ((stbi__uint64) z->s->img_y * index / c->tasks);
+   unsigned int j1 = (unsigned int) ((stbi__uint64) z->s->img_y * (index+1) / c->tasks);
+   unsigned int j, row_size = c->n * z->s->img_x;
+   stbi_uc *scratch = c->linebufs + index * (c->decode_n * (z->s->img_x + 3) + row_size + 1);
+   int k;
+   for (k=0; k < c->decode_n; ++k) {
+      r[k] = c->res_comp[k];
+      linebuf[k] = scratch;
+      scratch += z->s->img_x + 3;
+      // the resamplers only step through their input, so catch up to row j0
+      for (j=0; j < j0; ++j)
+         stbi__resample_next_row(&r[k], z->img_comp[k].y, z->img_comp[k].w2);
+   }
+   if (index == c->tasks-1) {
+      stbi__jpeg_convert_rows(z, r, linebuf, c->output + row_size * j0, c->n, c->decode_n, c->is_rgb, j0, j1);
+   } else {
+      // 3 channel rows are written with a byte to spare after them, which is
+      // in the next band for the last row; that one goes through scratch
+      stbi__jpeg_convert_rows(z, r, linebuf, c->output + row_size * j0, c->n, c->decode_n, c->is_rgb, j0, j1-1);
+      stbi__jpeg_convert_rows(z, r, linebuf, scratch, c->n, c->decode_n, c->is_rgb, j1-1, j1);
+      memcpy(c->output + row_size * (j1-1), scratch, row_size);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3742,9 +4092,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
       stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      stbi_uc *linebuf[4];
+      stbi__jpeg_convert c;
 
       stbi__resample res_comp[4];
 
@@ -3774,100 +4124,22 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
+      // now go ahead and resample, a band of rows per task
+      c.z = z;
+      c.res_comp = res_comp;
+      c.output = output;
+      c.n = n;
+      c.decode_n = decode_n;
+      c.is_rgb = is_rgb;
+      c.tasks = stbi__jpeg_parallel_tasks(z->s->img_y, 16);
+      c.linebufs = c.tasks > 1 ? (stbi_uc *) stbi__malloc_mad2(c.tasks, decode_n * (z->s->img_x + 3) + n * z->s->img_x + 1, 0) : NULL;
+      if (c.linebufs) {
+         stbi__jpeg_parallel(c.tasks, stbi__jpeg_convert_band, &c);
+         STBI_FREE(c.linebufs);
+      } else {
+         for (k=0; k < decode_n; ++k)
+            linebuf[k] = z->img_comp[k].linebuf;
+         stbi__jpeg_convert_rows(z, res_comp, linebuf, output, n, decode_n, is_rgb, 0, z->s->img_y);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -4165,6 +4437,219 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
    }
 }
 
+// fast inflate
+//    same output as stbi__parse_huffman_block for every valid stream, but
+//      - bits come from a 64-bit buffer refilled a word at a time, so one
+//        refill covers a whole length/distance pair
+//      - 11-bit length and 10-bit distance tables resolve nearly all codes in
+//        one lookup, and a length table entry can hold two literals at once
+//      - matches are copied a word at a time when they don't overlap a word
+
+static int stbi__zlib_fast_inflate = 1;
+
+STBIDEF void stbi_zlib_set_fast_inflate(int flag_true_if_should_use_fast)
+{
+   stbi__zlib_fast_inflate = flag_true_if_should_use_fast;
+}
+
+#define STBI__ZFAST_LENGTH_BITS  11
+#define STBI__ZFAST_DIST_BITS    10
+
+// table entries: bits 0-7 code length, 8-23 literal(s) or base value,
+// 24-27 extra bits, 28-31 kind; 0 means the code is longer than the table
+enum
+{
+   STBI__ZFAST_SLOW = 0,
+   STBI__ZFAST_LITERAL,
+   STBI__ZFAST_LITERAL2,
+   STBI__ZFAST_LENGTH,
+   STBI__ZFAST_END,
+   STBI__ZFAST_DIST
+};
+
+typedef struct
+{
+   stbi__uint32 length[1 << STBI__ZFAST_LENGTH_BITS];
+   stbi__uint32 dist[1 << STBI__ZFAST_DIST_BITS];
+} stbi__zfast_tables;
+
+static stbi__uint32 stbi__zfast_entry(int kind, int size, int value, int extra)
+{
+   return ((stbi__uint32) kind << 28) | ((stbi__uint32) extra << 24) | ((stbi__uint32) value << 8) | (stbi__uint32) size;
+}
+
+static stbi__uint32 stbi__zfast_symbol(int sym, int size, int is_dist)
+{
+   // length symbols 286-287 and distance symbols 30-31 aren't valid, but get
+   // the same zero base as in stbi__parse_huffman_block so both agree
+   if (is_dist) return stbi__zfast_entry(STBI__ZFAST_DIST, size, stbi__zdist_base[sym], stbi__zdist_extra[sym]);
+   if (sym < 256) return stbi__zfast_entry(STBI__ZFAST_LITERAL, size, sym, 0);
+   if (sym == 256) return stbi__zfast_entry(STBI__ZFAST_END, size, 0, 0);
+   return stbi__zfast_entry(STBI__ZFAST_LENGTH, size, stbi__zlength_base[sym-257], stbi__zlength_extra[sym-257]);
+}
+
+static void stbi__zbuild_fast(stbi__uint32 *table, int bits, const stbi__zhuffman *z, int is_dist)
+{
+   int s,i,k;
+   memset(table, 0, sizeof(*table) << bits);
+   for (s=1; s <= bits; ++s) {
+      int count = (z->maxcode[s] >> (16-s)) - z->firstcode[s];
+      for (i=0; i < count; ++i) {
+         stbi__uint32 e = stbi__zfast_symbol(z->value[z->firstsymbol[s] + i], s, is_dist);
+         for (k = stbi__bit_reverse(z->firstcode[s] + i, s); k < (1 << bits); k += 1 << s)
+            table[k] = e;
+      }
+   }
+   if (is_dist) return;
+   // where the bits after a literal also hold the whole code of another
+   // literal, decode both at once. going down from the top means table[k >> s]
+   // still holds a single symbol when it's looked at
+   for (k=(1 << bits)-1; k >= 0; --k) {
+      stbi__uint32 e = table[k], e2;
+      if ((e >> 28) != STBI__ZFAST_LITERAL) continue;
+      s = e & 255;
+      e2 = table[k >> s];
+      if ((e2 >> 28) == STBI__ZFAST_LITERAL && s + (int) (e2 & 255) <= bits)
+         table[k] = stbi__zfast_entry(STBI__ZFAST_LITERAL2, s + (e2 & 255), ((e >> 8) & 255) | ((e2 >> 8) & 255) << 8, 0);
+   }
+}
+
+// codes longer than the table, decoded like stbi__zhuffman_decode_slowpath
+static stbi__uint32 stbi__zfast_decode_slow(const stbi__zhuffman *z, stbi__uint64 code_buffer, int bits, int is_dist)
+{
+   int s, k = stbi__bit_reverse((int) (code_buffer & 0xffff), 16);
+   for (s=bits+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s == 16) return 0; // invalid code!
+   return stbi__zfast_symbol(z->value[(k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s]], s, is_dist);
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24)
+        | ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+}
+
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a)
+{
+   stbi__zfast_tables t;
+   char *zout = a->zout;
+   stbi_uc *in = a->zbuffer;
+   stbi__uint64 code_buffer = a->code_buffer;
+   int num_bits = a->num_bits;
+   int past_end = 0; // zero bytes added after the end of the input, like stbi__zget8 does
+   int result, unused;
+
+   stbi__zbuild_fast(t.length, STBI__ZFAST_LENGTH_BITS, &a->z_length, 0);
+   stbi__zbuild_fast(t.dist, STBI__ZFAST_DIST_BITS, &a->z_distance, 1);
+
+   for(;;) {
+      stbi__uint32 e;
+      int len, dist, extra;
+      // at least 56 bits, enough for a length/distance pair with all its extra bits
+      if (a->zbuffer_end - in >= 8) {
+         code_buffer |= stbi__zload64(in) << num_bits;
+         in += (63 - num_bits) >> 3;
+         num_bits |= 56;
+      } else {
+         while (num_bits <= 56) {
+            if (in < a->zbuffer_end)
+               code_buffer |= (stbi__uint64) *in++ << num_bits;
+            else
+               ++past_end;
+            num_bits += 8;
+         }
+      }
+
+      e = t.length[code_buffer & ((1 << STBI__ZFAST_LENGTH_BITS) - 1)];
+      if (!e) e = stbi__zfast_decode_slow(&a->z_length, code_buffer, STBI__ZFAST_LENGTH_BITS, 0);
+      code_buffer >>= e & 255;
+      num_bits -= e & 255;
+      switch (e >> 28) {
+         case STBI__ZFAST_LITERAL:
+            if (zout >= a->zout_end) {
+               if (!stbi__zexpand(a, zout, 1)) { result = 0; goto done; }
+               zout = a->zout;
+            }
+            *zout++ = (char) (e >> 8);
+            continue;
+         case STBI__ZFAST_LITERAL2:
+            if (a->zout_end - zout < 2) {
+               if (!stbi__zexpand(a, zout, 2)) { result = 0; goto done; }
+               zout = a->zout;
+            }
+            zout[0] = (char) (e >> 8);
+            zout[1] = (char) (e >> 16);
+            zout += 2;
+            continue;
+         case STBI__ZFAST_END:
+            result = 1;
+            goto done;
+         case STBI__ZFAST_LENGTH:
+            break;
+         default:
+            result = stbi__err("bad huffman code","Corrupt PNG");
+            goto done;
+      }
+
+      len = (e >> 8) & 0xffff;
+      extra = (e >> 24) & 15;
+      len += (int) (code_buffer & ((1 << extra) - 1));
+      code_buffer >>= extra;
+      num_bits -= extra;
+
+      e = t.dist[code_buffer & ((1 << STBI__ZFAST_DIST_BITS) - 1)];
+      if (!e) e = stbi__zfast_decode_slow(&a->z_distance, code_buffer, STBI__ZFAST_DIST_BITS, 1);
+      if ((e >> 28) != STBI__ZFAST_DIST) { result = stbi__err("bad huffman code","Corrupt PNG"); goto done; }
+      code_buffer >>= e & 255;
+      num_bits -= e & 255;
+      dist = (e >> 8) & 0xffff;
+      extra = (e >> 24) & 15;
+      dist += (int) (code_buffer & ((1 << extra) - 1));
+      code_buffer >>= extra;
+      num_bits -= extra;
+
+      if (zout - a->zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); goto done; }
+      if (a->zout_end - zout < len) {
+         if (!stbi__zexpand(a, zout, len)) { result = 0; goto done; }
+         zout = a->zout;
+      }
+      {
+         char *p = zout - dist, *end = zout + len;
+         if (dist >= 8 && a->zout_end - end >= 8) {
+            // the last word can go past the match, into space that isn't used yet
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+         } else if (dist == 1) { // run of one byte; common in images.
+            memset(zout, *p, len);
+            zout = end;
+         } else {
+            while (zout < end) *zout++ = *p++;
+         }
+      }
+   }
+
+done:
+   // give the whole bytes that are left back to the input, as the rest of
+   // the stream is read with the 32-bit buffer
+   unused = num_bits >> 3;
+   if (unused > (int) (in - a->zbuffer) + past_end)
+      unused = (int) (in - a->zbuffer) + past_end;
+   num_bits -= unused * 8;
+   if (unused > past_end)
+      in -= unused - past_end;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) (code_buffer & (((stbi__uint64) 1 << num_bits) - 1));
+   a->num_bits = num_bits;
+   a->zout = zout;
+   return result;
+}
+
 static int stbi__compute_huffman_codes(stbi__zbuf *a)
 {
    static const stbi_uc length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
@@ -4307,7 +4792,11 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
-         if (!stbi__parse_huffman_block(a)) return 0;
+         if (stbi__zlib_fast_inflate) {
+            if (!stbi__parse_huffman_block_fast(a)) return 0;
+         } else {
+            if (!stbi__parse_huffman_block(a)) return 0;
+         }
       }
    } while (!final);
    return 1;
@@ -4474,6 +4963,114 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+static int stbi__png_simd_unfilter = 1;
+
+STBIDEF void stbi_set_png_simd_unfilter(int flag_true_if_should_use_simd)
+{
+   stbi__png_simd_unfilter = flag_true_if_should_use_simd;
+}
+
+#ifdef STBI_SSE2
+// unfilter a whole scanline of 8-bit pixels with 3 or 4 channels, going to
+// 3 or 4 channels (with alpha 255 added). sub, avg and paeth each depend on
+// the pixel to the left, so this goes a pixel at a time with one pixel per
+// register; paeth works on 16-bit lanes like stbi__paeth does on ints
+// pixels are loaded and stored with exactly n bytes, as the last one may end the buffer
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n)
+{
+   int v;
+   if (n == 4)
+      memcpy(&v, p, 4);
+   else
+      v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+   int x = _mm_cvtsi128_si32(v);
+   if (n == 4)
+      memcpy(p, &x, 4);
+   else {
+      p[0] = STBI__BYTECAST(x);
+      p[1] = STBI__BYTECAST(x >> 8);
+      p[2] = STBI__BYTECAST(x >> 16);
+   }
+}
+
+static void stbi__png_unfilter_sse2(stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, stbi__uint32 x, int filter, int img_n, int out_n)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i alpha = _mm_cvtsi32_si128(img_n != out_n ? (int) 0xff000000 : 0);
+   __m128i a = zero, b, c = zero, d; // left, above, above left
+   stbi__uint32 i, k, nk = x*img_n;
+
+   switch (filter) {
+      case STBI__F_none:
+         if (img_n == out_n) {
+            memcpy(cur, raw, nk);
+            break;
+         }
+         for (i=0; i < x; ++i, raw += img_n, cur += out_n)
+            stbi__png_store_pixel(cur, _mm_or_si128(stbi__png_load_pixel(raw, img_n), alpha), out_n);
+         break;
+      case STBI__F_up:
+         if (img_n == out_n) {
+            for (k=0; k+16 <= nk; k += 16)
+               _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(_mm_loadu_si128((__m128i *) (raw+k)), _mm_loadu_si128((__m128i *) (prior+k))));
+            for (; k < nk; ++k)
+               cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+            break;
+         }
+         for (i=0; i < x; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            d = _mm_add_epi8(stbi__png_load_pixel(raw, img_n), stbi__png_load_pixel(prior, out_n));
+            stbi__png_store_pixel(cur, _mm_or_si128(d, alpha), out_n);
+         }
+         break;
+      case STBI__F_sub:
+      case STBI__F_paeth_first: // paeth(a,0,0) is always a
+         for (i=0; i < x; ++i, raw += img_n, cur += out_n) {
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, img_n), a);
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), out_n);
+         }
+         break;
+      case STBI__F_avg:
+      case STBI__F_avg_first:
+         // (a+b)>>1 in bytes: _mm_avg_epu8 rounds up, so take the odd sums back down
+         for (i=0; i < x; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            b = filter == STBI__F_avg ? stbi__png_load_pixel(prior, out_n) : zero;
+            d = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_add_epi8(stbi__png_load_pixel(raw, img_n), d);
+            stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), out_n);
+         }
+         break;
+      case STBI__F_paeth:
+         for (i=0; i < x; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            __m128i pa, pb, pc, smallest, pred;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, out_n), zero);
+            // with p = a+b-c: p-a = b-c, p-b = a-c and p-c = (b-c)+(a-c)
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pa, _mm_min_epi16(pb, pc));
+            // a if pa is the smallest, else b if pb is, else c
+            pb = _mm_cmpeq_epi16(pb, smallest);
+            pred = _mm_or_si128(_mm_and_si128(pb, b), _mm_andnot_si128(pb, c));
+            pa = _mm_cmpeq_epi16(pa, smallest);
+            pred = _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, pred));
+            d = _mm_add_epi8(stbi__png_load_pixel(raw, img_n), _mm_packus_epi16(pred, zero));
+            stbi__png_store_pixel(cur, _mm_or_si128(d, alpha), out_n);
+            a = _mm_unpacklo_epi8(d, zero);
+            c = b;
+         }
+         break;
+   }
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4487,6 +5084,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   #ifdef STBI_SSE2
+   int simd = depth == 8 && (img_n == 3 || img_n == 4) && stbi__png_simd_unfilter && stbi__sse2_available();
+   #endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4520,6 +5120,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+      #ifdef STBI_SSE2
+      if (simd) {
+         stbi__png_unfilter_sse2(cur, prior, raw, x, filter, img_n, out_n);
+         raw += x*img_n;
+         continue;
+      }
+      #endif
+
       // handle first byte explicitly
       for (k=0; k < filter_bytes; ++k) {
          switch (filter) {
@@ -5324,7 +5932,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
          psize = (info.offset - info.extra_read - info.hsz) >> 2;
    }
    if (psize == 0) {
-      STBI_ASSERT(info.offset == (s->img_buffer - s->buffer_start));
+      STBI_ASSERT(info.offset == (s->img_buffer - s->img_buffer_original));
    }
 
    if (info.bpp == 24 && ma == 0xff000000)
@@ -7039,7 +7647,7 @@ static int stbi__bmp_info(stbi__context *s, int *x, int *y, int *comp)
    if (p == NULL)
       return 0;
    if (x) *x = s->img_x;
-   if (y) *y = s->img_y;
+   if (y) *y = abs((int) s->img_y);
    if (comp) {
       if (info.bpp == 24 && info.ma == 0xff000000)
          *comp = 3;
@@ -7300,6 +7908,137 @@ static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp)
 }
 #endif
 
+// *************************************************************************************************
+// Quite OK Image Format loader
+//
+// QOI: https://qoiformat.org/qoi-specification.pdf
+//
+// A single pass over the pixels, each one a run, a reference into a table
+// of recently seen colours, a small difference to the previous pixel or a
+// literal, which makes it a lot faster to decode than PNG.
+
+#ifndef STBI_NO_QOI
+
+static int stbi__qoi_header(stbi__context *s, int *x, int *y, int *comp)
+{
+   stbi__uint32 w, h;
+   int channels, colorspace;
+   if (stbi__get8(s) != 'q' || stbi__get8(s) != 'o' || stbi__get8(s) != 'i' || stbi__get8(s) != 'f')
+      return 0;
+   w = stbi__get32be(s);
+   h = stbi__get32be(s);
+   channels = stbi__get8(s);
+   colorspace = stbi__get8(s);
+   if (w == 0 || h == 0 || (channels != 3 && channels != 4) || colorspace > 1)
+      return 0;
+   if (w > 0x7fffffff || h > 0x7fffffff)
+      return 0;
+   if (x) *x = (int) w;
+   if (y) *y = (int) h;
+   if (comp) *comp = channels;
+   return 1;
+}
+
+static int stbi__qoi_test(stbi__context *s)
+{
+   int r = stbi__qoi_header(s, NULL, NULL, NULL);
+   stbi__rewind(s);
+   return r;
+}
+
+static int stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp)
+{
+   int dummy;
+   if (!x) x = &dummy;
+   if (!y) y = &dummy;
+   if (!comp) comp = &dummy;
+   if (!stbi__qoi_header(s, x, y, comp)) {
+      stbi__rewind(s);
+      return 0;
+   }
+   return 1;
+}
+
+static void *stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   stbi_uc index[64][4];
+   stbi_uc px[4] = { 0, 0, 0, 255 };
+   stbi_uc *out, *p;
+   int n, run = 0;
+   size_t i, count;
+   STBI_NOTUSED(ri);
+
+   if (!stbi__qoi_header(s, (int *)&s->img_x, (int *)&s->img_y, &s->img_n))
+      return stbi__errpuc("bad QOI", "Corrupt QOI header");
+   n = s->img_n;
+   *x = s->img_x;
+   *y = s->img_y;
+   if (comp) *comp = n;
+
+   if (!stbi__mad3sizes_valid(n, s->img_x, s->img_y, 0))
+      return stbi__errpuc("too large", "QOI too large");
+   out = (stbi_uc *) stbi__malloc_mad3(n, s->img_x, s->img_y, 0);
+   if (!out) return stbi__errpuc("outofmem", "Out of memory");
+
+   memset(index, 0, sizeof(index));
+   count = (size_t) s->img_x * s->img_y;
+   for (i = 0, p = out; i < count; ++i, p += n) {
+      if (run > 0) {
+         --run;
+      } else {
+         int b1 = stbi__get8(s);
+         if (b1 == 0xfe) {            // QOI_OP_RGB
+            px[0] = stbi__get8(s);
+            px[1] = stbi__get8(s);
+            px[2] = stbi__get8(s);
+         } else if (b1 == 0xff) {     // QOI_OP_RGBA
+            px[0] = stbi__get8(s);
+            px[1] = stbi__get8(s);
+            px[2] = stbi__get8(s);
+            px[3] = stbi__get8(s);
+         } else switch (b1 >> 6) {
+            case 0:                   // QOI_OP_INDEX
+               memcpy(px, index[b1], 4);
+               break;
+            case 1:                   // QOI_OP_DIFF
+               px[0] = STBI__BYTECAST(px[0] + ((b1 >> 4) & 3) - 2);
+               px[1] = STBI__BYTECAST(px[1] + ((b1 >> 2) & 3) - 2);
+               px[2] = STBI__BYTECAST(px[2] + ( b1       & 3) - 2);
+               break;
+            case 2: {                 // QOI_OP_LUMA
+               int b2 = stbi__get8(s);
+               int dg = (b1 & 0x3f) - 32;
+               px[0] = STBI__BYTECAST(px[0] + dg - 8 + ((b2 >> 4) & 15));
+               px[1] = STBI__BYTECAST(px[1] + dg);
+               px[2] = STBI__BYTECAST(px[2] + dg - 8 + ( b2       & 15));
+               break;
+            }
+            default:                  // QOI_OP_RUN
+               run = b1 & 0x3f;
+               break;
+         }
+         memcpy(index[(px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) & 63], px, 4);
+      }
+      p[0] = px[0];
+      p[1] = px[1];
+      p[2] = px[2];
+      if (n == 4) p[3] = px[3];
+   }
+   // the stream ends with an 8 byte marker, so running into the end of the
+   // data while still decoding pixels means the file was cut short
+   if (stbi__at_eof(s)) {
+      STBI_FREE(out);
+      return stbi__errpuc("bad QOI", "Corrupt QOI: truncated data");
+   }
+
+   if (req_comp && req_comp != n) {
+      out = stbi__convert_format(out, n, req_comp, s->img_x, s->img_y);
+      if (out == NULL) return out; // stbi__convert_format frees input on failure
+   }
+   return out;
+}
+#endif
+
 static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
 {
    #ifndef STBI_NO_JPEG
@@ -7330,6 +8069,10 @@ static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
    if (stbi__pnm_info(s, x, y, comp))  return 1;
    #endif
 
+   #ifndef STBI_NO_QOI
+   if (stbi__qoi_info(s, x, y, comp))  return 1;
+   #endif
+
    #ifndef STBI_NO_HDR
    if (stbi__hdr_info(s, x, y, comp))  return 1;
    #endif
@@ -2396,8 +2396,10 @@ static int stbir__resize_allocated(stbir__info *info,
 
 #undef STBIR__NEXT_MEMPTR
 
-    // This signals that the ring buffer is empty
+    // This signals that the ring buffer is empty; the scanlines are set too, since GCC can't tell they are only read once it isn't
     info->ring_buffer_begin_index = -1;
+    info->ring_buffer_first_scanline = 0;
+    info->ring_buffer_last_scanline = 0;
 
     stbir__calculate_filters(info->horizontal_contributors, info->horizontal_coefficients, info->horizontal_filter, info->horizontal_scale, info->horizontal_shift, info->input_w, info->output_w);
     stbir__calculate_filters(info->vertical_contributors, info->vertical_coefficients, info->vertical_filter, info->vertical_scale, info->vertical_shift, info->input_h, info->output_h);